@@ -0,0 +1,139 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Kernel timing and traffic model shared by the benchmarks
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#pragma once
+
+#include <fvhyper/mesh.h>
+#include <fvhyper/explicit.h>
+#include <fvhyper/parallel.h>
+
+#include <chrono>
+#include <string>
+
+
+/*
+    Compulsory bytes moved by one call of each kernel: every array it
+    touches moved once, twice if it is updated in place
+*/
+namespace traffic {
+    const double d = sizeof(double);
+    const double u = sizeof(uint);
+    const double V = fvhyper::vars;
+
+    inline double gradients(const fvhyper::mesh& m) {
+        const double C = m.cellsAreas.size();
+        const double E = m.edgesLengths.size();
+        // edge cells, normals, length and center; cell centers, q, gx and gy updated, areas
+        return E*(2*u + 5*d) + C*(2*d + V*d + 4*V*d) + m.nRealCells*d;
+    }
+
+    inline double limiters(const fvhyper::mesh& m) {
+        const double C = m.cellsAreas.size();
+        const double E = m.edgesLengths.size();
+        // edge cells and center; cell centers and area, q, gx, gy, qmin and qmax updated, limiters updated
+        return E*(2*u + 2*d) + C*(3*d + 3*V*d + 4*V*d + 2*V*d);
+    }
+
+    inline double time_derivatives(const fvhyper::mesh& m) {
+        const double C = m.cellsAreas.size();
+        const double E = m.edgesLengths.size();
+        // edge cells, normals, length and center; cell centers and area, q, gx, gy, limiters, qt updated
+        return E*(2*u + 5*d) + C*(3*d + 4*V*d + 2*V*d);
+    }
+
+    inline double bounds(const fvhyper::mesh& m) {
+        const double B = m.boundaryEdges.size();
+        // boundary edge, its cells, normal, center and function; interior center, q, gx, gy, limiters; ghost q
+        return B*(3*u + 4*d + sizeof(void*)) + B*(2*d + 4*V*d + V*d);
+    }
+
+    inline double smoothing(const fvhyper::mesh& m, const uint iters) {
+        const double C = m.cellsAreas.size();
+        const double E = m.edgesLengths.size();
+        // copy of qt; per sweep edge cells, qt and smoother updated, then smoother_qt, qt updated, smoother reset
+        return C*3*V*d + iters*(E*2*u + C*(3*V*d + 4*V*d));
+    }
+
+    inline double roe_flux(const fvhyper::mesh& m) {
+        const double C = m.cellsAreas.size();
+        const double E = m.edgesLengths.size();
+        // edge cells and normals, flux written; q
+        return E*(2*u + 2*d + V*d) + C*V*d;
+    }
+}
+
+
+
+/*
+    Seconds per call of kernel on the slowest rank
+    Repeats until min_time has passed on rank 0, every rank doing as many calls
+*/
+template<class F>
+double seconds_per_call(F kernel, const double min_time) {
+    kernel();
+    uint reps = 0;
+    double elapsed = 0.;
+    MPI_Barrier(MPI_COMM_WORLD);
+    auto start = std::chrono::steady_clock::now();
+    int done = 0;
+    while (!done) {
+        kernel();
+        reps += 1;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        done = (reps >= 3) && (elapsed >= min_time);
+        MPI_Bcast(&done, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    }
+    double seconds = elapsed/reps;
+    MPI_Allreduce(MPI_IN_PLACE, &seconds, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    return seconds;
+}
+
+
+class kernel_result {
+public:
+    std::string name;
+    double seconds;     // per call, slowest rank
+    double cells;       // cells updated, all ranks
+    double edges;       // edges looped over, all ranks
+    double bytes;       // all ranks
+    double flops;       // all ranks
+};
+
+
+// Times kernel, the counts of one call on this rank are summed over the ranks,
+//  flops are only counted by the roofline
+template<class F>
+kernel_result time_kernel(
+    const std::string name,
+    F kernel,
+    const double min_time,
+    const double cells,
+    const double edges,
+    const double bytes,
+    fvhyper::mpi_wrapper& pool,
+    const double flops = 0.
+) {
+    double local[4] = {cells, edges, bytes, flops};
+    double total[4];
+    kernel_result r;
+    r.name = name;
+    r.seconds = seconds_per_call(kernel, min_time);
+    MPI_Allreduce(local, total, 4, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    r.cells = total[0];
+    r.edges = total[1];
+    r.bytes = total[2];
+    r.flops = total[3];
+    return r;
+}
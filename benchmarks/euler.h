@@ -0,0 +1,210 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Euler problem of the kernel benchmarks
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#pragma once
+
+#include <fvhyper/mesh.h>
+#include <fvhyper/explicit.h>
+#include <fvhyper/post.h>
+
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+
+/*
+    Euler equations with the Roe flux on a closed box, the problem of the
+    kernel benchmarks. Defines the solver globals, include it in the one
+    source file of a benchmark program.
+*/
+namespace fvhyper {
+
+
+    // Define global constants
+    const int vars = 4;
+    const std::vector<std::string> var_names = {
+        "rho",
+        "rhou",
+        "rhov",
+        "rhoe"
+    };
+    namespace solver {
+        const bool do_calc_gradients = true;
+        const bool do_calc_limiters = true;
+        const bool linear_interpolate = true;
+        const bool diffusive_gradients = false;
+        const bool global_dt = false;
+        const bool smooth_residuals = true;
+    }
+
+    namespace consts {
+        double gamma = 1.4;
+        double cfl = 1.0;
+    }
+
+    inline double calc_p(const double* q) {
+        return (consts::gamma - 1)*(q[3] - 0.5/q[0]*(q[1]*q[1] + q[2]*q[2]));
+    }
+
+    /*
+        Define initial solution
+        A density and pressure jump at x = 0.5 over a wavy flow, so the
+        limiters take all their branches
+    */
+    void generate_initial_solution(
+        std::vector<double>& v,
+        const mesh& m
+    ) {
+        for (uint i=0; i<m.cellsAreas.size(); ++i) {
+            const double x = m.cellsCentersX[i];
+            const double y = m.cellsCentersY[i];
+            const double rho = (x < 0.5) ? 1.4 : 1.0;
+            const double p = (x < 0.5) ? 1.0 : 0.8;
+            const double u = 0.5 + 0.1*sin(6.283185307*y);
+            const double w = 0.1*sin(6.283185307*x);
+            v[4*i] = rho;
+            v[4*i+1] = rho*u;
+            v[4*i+2] = rho*w;
+            v[4*i+3] = p/(consts::gamma-1) + 0.5*rho*(u*u + w*w);
+        }
+    }
+
+    // Michalak limiter function
+    double limiter_func(const double& y) {
+        const double yt = 2.0;
+        if (y >= yt) {
+            return 1.0;
+        } else {
+            const double a = 1.0/(yt*yt) - 2.0/(yt*yt*yt);
+            const double b = -3.0/2.0*a*yt - 0.5/yt;
+            return a*y*y*y + b*y*y + y;
+        }
+    }
+
+    /*
+        Define flux function for the euler equations
+        Roe flux vector differencing
+    */
+    void calc_flux(
+        double* f,
+        const double* qi,
+        const double* qj,
+        const double* gx,
+        const double* gy,
+        const double* n
+    ) {
+
+        // Central flux
+        double pi, pj, Vi, Vj;
+        pi = (consts::gamma - 1)*(qi[3] - 0.5/qi[0]*(qi[1]*qi[1] + qi[2]*qi[2]));
+        pj = (consts::gamma - 1)*(qj[3] - 0.5/qj[0]*(qj[1]*qj[1] + qj[2]*qj[2]));
+        Vi = (qi[1]*n[0] + qi[2]*n[1])/qi[0];
+        Vj = (qj[1]*n[0] + qj[2]*n[1])/qj[0];
+
+        f[0] = qi[0]*Vi;
+        f[1] = qi[1]*Vi + pi*n[0];
+        f[2] = qi[2]*Vi + pi*n[1];
+        f[3] = (qi[3] + pi)*Vi;
+
+        f[0] += qj[0]*Vj;
+        f[1] += qj[1]*Vj + pj*n[0];
+        f[2] += qj[2]*Vj + pj*n[1];
+        f[3] += (qj[3] + pj)*Vj;
+
+        for (uint i=0; i<4; ++i) f[i] *= 0.5;
+
+        // Upwind flux
+        const double pL = pi;
+        const double pR = pj;
+
+        // Roe variables
+        const double uL = qi[1]/qi[0];
+        const double uR = qj[1]/qj[0];
+        const double vL = qi[2]/qi[0];
+        const double vR = qj[2]/qj[0];
+
+        const double srhoL = sqrt(qi[0]);
+        const double srhoR = sqrt(qj[0]);
+        const double rho = srhoR*srhoL;
+        const double u = (uL*srhoL + uR*srhoR)/(srhoL + srhoR);
+        const double v = (vL*srhoL + vR*srhoR)/(srhoL + srhoR);
+        const double h = ((qi[3] + pL)/qi[0]*srhoL + (qj[3] + pR)/qj[0]*srhoR)/(srhoL + srhoR);
+        const double q2 = u*u + v*v;
+        const double c = sqrt( (consts::gamma - 1.) * (h - 0.5*q2) );
+        const double V = u*n[0] + v*n[1];
+        const double VR = uR*n[0] + vR*n[1];
+        const double VL = uL*n[0] + vL*n[1];
+
+        // Roe correction
+        const double lambda_cm = abs(std::min(V-c, VL-c));
+        const double lambda_c  = abs(V);
+        const double lambda_cp = abs(std::max(V+c, VR+c));
+
+        const double kF1 = lambda_cm*((pR-pL) - rho*c*(VR-VL))/(2.*c*c);
+        const double kF234_0 = lambda_c*((qj[0] - qi[0]) - (pR-pL)/(c*c));
+        const double kF234_1 = lambda_c*rho;
+        const double kF5 = lambda_cp*((pR-pL) + rho*c*(VR-VL))/(2*c*c);
+
+        // Roe flux
+        f[0] -= 0.5*(kF1            + kF234_0                                                       + kF5);
+        f[1] -= 0.5*(kF1*(u-c*n[0]) + kF234_0*u      + kF234_1*(uR - uL - (VR-VL)*n[0])             + kF5*(u+c*n[0]));
+        f[2] -= 0.5*(kF1*(v-c*n[1]) + kF234_0*v      + kF234_1*(vR - vL - (VR-VL)*n[1])             + kF5*(v+c*n[1]));
+        f[3] -= 0.5*(kF1*(h-c*V)    + kF234_0*q2*0.5 + kF234_1*(u*(uR-uL) + v*(vR-vL) - V*(VR-VL))  + kF5*(h+c*V)); 
+    }
+
+    /*
+        Define the time step, not timed here
+    */
+    void calc_dt(
+        std::vector<double>& dt,
+        const std::vector<double>& q,
+        mesh& m
+    ) {
+        for (uint i=0; i<dt.size(); ++i) {
+            dt[i] = 1e-3;
+        }
+    }
+
+
+    namespace boundaries {
+
+        void wall(double* b, double* q, double* n) {
+            // Flip velocity, doesn't change norm of velocity
+            b[0] = q[0];
+            b[1] = q[1] - 2.0 * n[0] * (n[0]*q[1] + n[1]*q[2]);
+            b[2] = q[2] - 2.0 * n[1] * (n[0]*q[1] + n[1]*q[2]);
+            b[3] = q[3];
+        }
+        std::map<std::string, void (*)(double*, double*, double*)> 
+        bounds = {
+            {"bottom", wall},
+            {"right", wall},
+            {"top", wall},
+            {"left", wall}
+        };
+    }
+
+
+    namespace post {
+        std::map<std::string, void (*)(double*, double*)> 
+            extra_scalars = {};
+        
+        std::map<std::string, void (*)(double*, double*)> 
+            extra_vectors = {};
+    }
+
+
+}
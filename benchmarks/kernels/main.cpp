@@ -0,0 +1,148 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Kernel microbenchmarks on generated meshes
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#include <fvhyper/mesh.h>
+#include <fvhyper/explicit.h>
+#include <fvhyper/parallel.h>
+#include <fvhyper/post.h>
+#include <benchmarks/euler.h>
+#include <benchmarks/common.h>
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+
+/*
+    Times the explicit solver kernels one at a time on in-memory meshes of
+    increasing size, from cache resident to memory bound, for the euler
+    equations with the Roe flux. Usage:
+
+        mpirun -n 1 ./main [--tri] [--jitter 0.2] [--shuffle]
+                           [--sizes 32,64,128,256,512,1024] [--time 0.2]
+                           [--csv kernels.csv]
+
+    Each size is an n by n square, of quads or of triangles with --tri.
+    With several ranks, every rank runs the kernels on its strip at the same
+    time and the slowest rank sets the time.
+
+    Bandwidth is the compulsory traffic of each kernel over the time, see
+    benchmarks/common.h. Real traffic is higher with poor locality, so
+    shuffled meshes show it as a lower bandwidth.
+*/
+int main(int argc, char** argv) {
+    fvhyper::mpi_wrapper pool;
+
+    fvhyper::generatorOptions gen;
+    std::vector<uint> sizes = {32, 64, 128, 256, 512, 1024};
+    double min_time = 0.2;
+    std::string csv_file = "";
+
+    for (int a=1; a<argc; ++a) {
+        const std::string arg = argv[a];
+        const bool has_value = (a + 1) < argc;
+        if (arg == "--tri") {
+            gen.triangles = true;
+        } else if (arg == "--shuffle") {
+            gen.shuffle = true;
+        } else if ((arg == "--jitter") && has_value) {
+            gen.jitter = atof(argv[++a]);
+        } else if ((arg == "--time") && has_value) {
+            min_time = atof(argv[++a]);
+        } else if ((arg == "--csv") && has_value) {
+            csv_file = argv[++a];
+        } else if ((arg == "--sizes") && has_value) {
+            sizes.clear();
+            std::stringstream ss(argv[++a]);
+            std::string s;
+            while (std::getline(ss, s, ',')) sizes.push_back(std::stoi(s));
+        } else {
+            if (pool.rank == 0) {
+                std::cout << "Unknown argument " << arg << "\n";
+                std::cout << "Usage: main [--tri] [--jitter f] [--shuffle] [--sizes n,n,..] [--time s] [--csv file]\n";
+            }
+            return pool.exit();
+        }
+    }
+
+    std::ofstream csv;
+    if ((pool.rank == 0) && (csv_file != "")) {
+        csv.open(csv_file);
+        csv << "n,cells,edges,kernel,seconds,cells_per_s,edges_per_s,bytes,gb_per_s\n";
+    }
+
+    fvhyper::solverOptions opt;
+
+    for (auto n : sizes) {
+        gen.nx = n;
+        gen.ny = n;
+        fvhyper::mesh m;
+        m.generate(gen, pool);
+
+        const uint size = fvhyper::vars*m.cellsAreas.size();
+        std::vector<double> q(size), qt(size), gx(size), gy(size), limiters(size);
+        std::vector<double> qmin(size), qmax(size), smoother_qt(size), smoother(size);
+        fvhyper::generate_initial_solution(q, m);
+
+        double cells = 0.;
+        for (uint i=0; i<m.nRealCells; ++i) cells += m.cellsIsGhost[i] ? 0. : 1.;
+        const double edges = m.edgesLengths.size();
+        const double bounds = m.boundaryEdges.size();
+
+        std::vector<kernel_result> results;
+        results.push_back(time_kernel("calc_gradients",
+            [&]() { fvhyper::calc_gradients(gx, gy, q, m); },
+            min_time, cells, edges, traffic::gradients(m), pool));
+        results.push_back(time_kernel("calc_limiters",
+            [&]() { fvhyper::calc_limiters(limiters, qmin, qmax, q, gx, gy, m); },
+            min_time, cells, edges, traffic::limiters(m), pool));
+        results.push_back(time_kernel("update_bounds",
+            [&]() { fvhyper::update_bounds(q, gx, gy, limiters, m); },
+            min_time, bounds, bounds, traffic::bounds(m), pool));
+        results.push_back(time_kernel("calc_time_derivatives",
+            [&]() { fvhyper::calc_time_derivatives(qt, q, gx, gy, limiters, m); },
+            min_time, cells, edges, traffic::time_derivatives(m), pool));
+        results.push_back(time_kernel("smooth_residuals",
+            [&]() { fvhyper::smooth_residuals(qt, smoother_qt, smoother, m, pool, opt); },
+            min_time, cells, edges*opt.smooth_iters, traffic::smoothing(m, opt.smooth_iters), pool));
+
+        if (pool.rank == 0) {
+            const double working_set = results[3].bytes;
+            std::cout << "\n" << n << " x " << n << (gen.triangles ? " triangles" : " quads")
+                << ", " << (uint) results[0].cells << " cells, " << (uint) results[0].edges << " edges, "
+                << std::fixed << std::setprecision(1) << working_set/1e6 << " MB working set\n";
+            std::cout << std::left << std::setw(24) << "Kernel" << std::right
+                << std::setw(12) << "us/call"
+                << std::setw(12) << "Mcells/s"
+                << std::setw(12) << "Medges/s"
+                << std::setw(12) << "GB/s" << "\n";
+            for (auto& r : results) {
+                std::cout << std::left << std::setw(24) << r.name << std::right << std::fixed
+                    << std::setw(12) << std::setprecision(1) << r.seconds*1e6
+                    << std::setw(12) << std::setprecision(1) << r.cells/r.seconds/1e6
+                    << std::setw(12) << std::setprecision(1) << r.edges/r.seconds/1e6
+                    << std::setw(12) << std::setprecision(2) << r.bytes/r.seconds/1e9 << "\n";
+                if (csv.is_open()) {
+                    csv << std::setprecision(9) << std::defaultfloat
+                        << n << "," << r.cells << "," << r.edges << "," << r.name << ","
+                        << r.seconds << "," << r.cells/r.seconds << "," << r.edges/r.seconds << ","
+                        << r.bytes << "," << r.bytes/r.seconds/1e9 << "\n";
+                }
+            }
+        }
+    }
+
+    return pool.exit();
+}
@@ -0,0 +1,324 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Roofline of the explicit kernels on generated meshes
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#include <fvhyper/mesh.h>
+#include <fvhyper/explicit.h>
+#include <fvhyper/parallel.h>
+#include <fvhyper/post.h>
+#include <benchmarks/euler.h>
+#include <benchmarks/common.h>
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+
+/*
+    Places the explicit solver kernels on a roofline, for the euler
+    equations with the Roe flux on in-memory meshes. Usage:
+
+        mpirun -n 1 ./main [--tri] [--jitter 0.2] [--shuffle]
+                           [--sizes 64,256,1024] [--time 0.2]
+                           [--stream-mb 64] [--bandwidth GB/s] [--peak GFLOP/s]
+                           [--csv roofline.csv]
+
+    The bytes of each kernel are its compulsory traffic, as counted in
+    benchmarks/common.h for benchmarks/kernels, and its flops are
+    counted from the source: one per add, multiply, divide, square root,
+    min, max or abs. Their ratio is the arithmetic intensity.
+
+    The roofs are measured at startup, on every rank at once: a STREAM
+    triad over --stream-mb per array for the bandwidth, and independent
+    multiply-add chains compiled with the same flags for the peak flops.
+    The roof of a kernel is min(peak, intensity x bandwidth), the % of
+    roof is the achieved GFLOP/s over it. Both roofs can be given instead
+    with --bandwidth and --peak, e.g. from the node specifications.
+*/
+
+
+/*
+    Flops of one call of each kernel, along the source of explicit.cpp
+*/
+namespace flops {
+    const double V = fvhyper::vars;
+
+    // Roe flux of calc_flux in benchmarks/euler.h, per edge
+    //   central flux: pressures 16, normal velocities 8, fluxes 18, halving 4
+    //   roe averages: velocities 4, roots 2, rho, u, v, h 18, q2 3, c 5, normal velocities 9
+    //   wave speeds 9, wave strengths 17, upwind correction 56
+    const double roe = 46 + 41 + 9 + 17 + 56;
+
+    double gradients(const fvhyper::mesh& m) {
+        const double E = m.edgesLengths.size();
+        // per edge: distances 12, weight 2, face values 4V, both cells 6V; per real cell: 1/area and scaling 2V
+        return E*(14 + 10*V) + m.nRealCells*(1 + 2*V);
+    }
+
+    double limiters(fvhyper::mesh& m) {
+        // Real cells on each side of the edges, the limiter is only computed for those
+        double sides = 0.;
+        for (uint e=0; e<m.edgesLengths.size(); ++e) {
+            for (uint s=0; s<2; ++s) {
+                const uint id = m.edgesCells(e, s);
+                sides += ((id < m.nRealCells) && !m.cellsIsGhost[id]) ? 1. : 0.;
+            }
+        }
+        const double E = m.edgesLengths.size();
+        // per edge: min and max 4V; per side: offsets and root 3, then per variable the
+        // projected gradient 3, deltas 2, smoothness threshold 5, ratio 1, limiter
+        // function 6, blend 3 and min 1, when the limiter function is evaluated
+        return E*4*V + sides*(3 + 21*V);
+    }
+
+    double time_derivatives(const fvhyper::mesh& m) {
+        const double E = m.edgesLengths.size();
+        // per edge: offsets 4, reconstruction 10V, roe flux, update of both cells 6V
+        return E*(4 + 16*V + roe);
+    }
+
+    double roe_flux(const fvhyper::mesh& m) {
+        return m.edgesLengths.size()*roe;
+    }
+}
+
+
+/*
+    Roe flux of every edge from the cell values, without reconstruction
+*/
+void roe_fluxes(std::vector<double>& f, const std::vector<double>& q, fvhyper::mesh& m) {
+    const uint vars = fvhyper::vars;
+    const double zeros[vars] = {};
+    for (uint e=0; e<m.edgesLengths.size(); ++e) {
+        const uint i = m.edgesCells(e, 0);
+        const uint j = m.edgesCells(e, 1);
+        const double n[2] = {m.edgesNormalsX[e], m.edgesNormalsY[e]};
+        fvhyper::calc_flux(&f[vars*e], &q[vars*i], &q[vars*j], zeros, zeros, n);
+    }
+}
+
+
+
+/*
+    Roofs of this machine, summed over the ranks
+*/
+class roofs {
+public:
+    double bandwidth;   // bytes/s
+    double peak;        // flops/s
+};
+
+
+// Best STREAM triad a = b + s c of every rank at once, in bytes/s over all ranks
+double stream_triad(const double megabytes, const double min_time, fvhyper::mpi_wrapper& pool) {
+    const uint n = megabytes*1e6/sizeof(double);
+    std::vector<double> a(n, 0.), b(n, 1.), c(n, 2.);
+    const double s = 3.;
+    double best = 1e300;
+    double elapsed = 0.;
+    uint reps = 0;
+    int done = 0;
+    while (!done) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        const auto start = std::chrono::steady_clock::now();
+        for (uint i=0; i<n; ++i) {
+            a[i] = b[i] + s*c[i];
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        MPI_Allreduce(MPI_IN_PLACE, &seconds, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        // The first pass faults the pages of a in
+        if (reps > 0) best = std::min(best, seconds);
+        elapsed += seconds;
+        reps += 1;
+        done = (reps >= 4) && (elapsed >= min_time);
+        MPI_Bcast(&done, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    }
+    // Keep the loop, a[n-1] is 7
+    if (a[n - 1] != 7.) std::cout << "";
+    return 3.*sizeof(double)*n*pool.size/best;
+}
+
+
+// Independent multiply-add chains that fit in registers, in flops/s over all ranks
+double peak_flops(const double min_time, fvhyper::mpi_wrapper& pool) {
+    const uint chains = 32;
+    const uint inner = 4096;
+    double x[chains];
+    for (uint k=0; k<chains; ++k) x[k] = 1. + 1e-3*k;
+    const double b = 0.999999;
+    const double c = 1e-7;
+
+    double best = 1e300;
+    double elapsed = 0.;
+    uint reps = 0;
+    int done = 0;
+    while (!done) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        const auto start = std::chrono::steady_clock::now();
+        for (uint r=0; r<inner; ++r) {
+            for (uint k=0; k<chains; ++k) {
+                x[k] = x[k]*b + c;
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        MPI_Allreduce(MPI_IN_PLACE, &seconds, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        best = std::min(best, seconds);
+        elapsed += seconds;
+        reps += 1;
+        done = (reps >= 10) && (elapsed >= min_time);
+        MPI_Bcast(&done, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    }
+    // Keep the chains
+    double sum = 0.;
+    for (uint k=0; k<chains; ++k) sum += x[k];
+    if (sum == 0.) std::cout << "";
+    return 2.*chains*inner*pool.size/best;
+}
+
+
+
+int main(int argc, char** argv) {
+    fvhyper::mpi_wrapper pool;
+
+    fvhyper::generatorOptions gen;
+    std::vector<uint> sizes = {64, 256, 1024};
+    double min_time = 0.2;
+    double stream_mb = 64.;
+    roofs roof = {0., 0.};
+    std::string csv_file = "";
+
+    for (int a=1; a<argc; ++a) {
+        const std::string arg = argv[a];
+        const bool has_value = (a + 1) < argc;
+        if (arg == "--tri") {
+            gen.triangles = true;
+        } else if (arg == "--shuffle") {
+            gen.shuffle = true;
+        } else if ((arg == "--jitter") && has_value) {
+            gen.jitter = atof(argv[++a]);
+        } else if ((arg == "--time") && has_value) {
+            min_time = atof(argv[++a]);
+        } else if ((arg == "--stream-mb") && has_value) {
+            stream_mb = atof(argv[++a]);
+        } else if ((arg == "--bandwidth") && has_value) {
+            roof.bandwidth = atof(argv[++a])*1e9;
+        } else if ((arg == "--peak") && has_value) {
+            roof.peak = atof(argv[++a])*1e9;
+        } else if ((arg == "--csv") && has_value) {
+            csv_file = argv[++a];
+        } else if ((arg == "--sizes") && has_value) {
+            sizes.clear();
+            std::stringstream ss(argv[++a]);
+            std::string s;
+            while (std::getline(ss, s, ',')) sizes.push_back(std::stoi(s));
+        } else {
+            if (pool.rank == 0) {
+                std::cout << "Unknown argument " << arg << "\n";
+                std::cout << "Usage: main [--tri] [--jitter f] [--shuffle] [--sizes n,n,..] [--time s]\n";
+                std::cout << "            [--stream-mb mb] [--bandwidth GB/s] [--peak GFLOP/s] [--csv file]\n";
+            }
+            return pool.exit();
+        }
+    }
+
+    const bool measured_bandwidth = roof.bandwidth <= 0.;
+    const bool measured_peak = roof.peak <= 0.;
+    if (measured_bandwidth) roof.bandwidth = stream_triad(stream_mb, min_time, pool);
+    if (measured_peak) roof.peak = peak_flops(min_time, pool);
+    if (pool.rank == 0) {
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << "Bandwidth " << roof.bandwidth/1e9 << " GB/s"
+            << (measured_bandwidth ? " (STREAM triad, " : " (given, ") << pool.size << ((pool.size > 1) ? " ranks)\n" : " rank)\n");
+        std::cout << "Peak " << roof.peak/1e9 << " GFLOP/s"
+            << (measured_peak ? " (multiply-add chains, " : " (given, ") << pool.size << ((pool.size > 1) ? " ranks)\n" : " rank)\n");
+        std::cout << "Ridge point " << roof.peak/roof.bandwidth << " flop/byte\n";
+    }
+
+    std::ofstream csv;
+    if ((pool.rank == 0) && (csv_file != "")) {
+        csv.open(csv_file);
+        csv << "n,edges,kernel,seconds,bytes,flops,intensity,gb_per_s,gflop_per_s,roof_gflop_per_s,percent_roof,bound\n";
+    }
+
+    for (auto n : sizes) {
+        gen.nx = n;
+        gen.ny = n;
+        fvhyper::mesh m;
+        m.generate(gen, pool);
+
+        const uint size = fvhyper::vars*m.cellsAreas.size();
+        std::vector<double> q(size), qt(size), gx(size), gy(size), limiters(size);
+        std::vector<double> qmin(size), qmax(size);
+        std::vector<double> f(fvhyper::vars*m.edgesLengths.size());
+        fvhyper::generate_initial_solution(q, m);
+        fvhyper::calc_gradients(gx, gy, q, m);
+
+        double cells = 0.;
+        for (uint i=0; i<m.nRealCells; ++i) cells += m.cellsIsGhost[i] ? 0. : 1.;
+        const double edges = m.edgesLengths.size();
+
+        std::vector<kernel_result> results;
+        results.push_back(time_kernel("calc_gradients",
+            [&]() { fvhyper::calc_gradients(gx, gy, q, m); },
+            min_time, cells, edges, traffic::gradients(m), pool, flops::gradients(m)));
+        results.push_back(time_kernel("calc_limiters",
+            [&]() { fvhyper::calc_limiters(limiters, qmin, qmax, q, gx, gy, m); },
+            min_time, cells, edges, traffic::limiters(m), pool, flops::limiters(m)));
+        results.push_back(time_kernel("calc_time_derivatives",
+            [&]() { fvhyper::calc_time_derivatives(qt, q, gx, gy, limiters, m); },
+            min_time, cells, edges, traffic::time_derivatives(m), pool, flops::time_derivatives(m)));
+        results.push_back(time_kernel("roe_flux",
+            [&]() { roe_fluxes(f, q, m); },
+            min_time, cells, edges, traffic::roe_flux(m), pool, flops::roe_flux(m)));
+
+        if (pool.rank == 0) {
+            std::cout << "\n" << n << " x " << n << (gen.triangles ? " triangles" : " quads")
+                << ", " << (uint) results[0].edges << " edges\n";
+            std::cout << std::left << std::setw(24) << "Kernel" << std::right
+                << std::setw(10) << "flop/edge"
+                << std::setw(10) << "B/edge"
+                << std::setw(10) << "flop/B"
+                << std::setw(10) << "GB/s"
+                << std::setw(10) << "GFLOP/s"
+                << std::setw(10) << "Roof"
+                << std::setw(10) << "% roof"
+                << std::setw(10) << "Bound" << "\n";
+            for (auto& r : results) {
+                const double intensity = r.flops/r.bytes;
+                const double achieved = r.flops/r.seconds;
+                const double attainable = std::min(roof.peak, intensity*roof.bandwidth);
+                const std::string bound = (intensity*roof.bandwidth < roof.peak) ? "memory" : "compute";
+                std::cout << std::left << std::setw(24) << r.name << std::right << std::fixed
+                    << std::setw(10) << std::setprecision(1) << r.flops/r.edges
+                    << std::setw(10) << std::setprecision(1) << r.bytes/r.edges
+                    << std::setw(10) << std::setprecision(2) << intensity
+                    << std::setw(10) << std::setprecision(2) << r.bytes/r.seconds/1e9
+                    << std::setw(10) << std::setprecision(2) << achieved/1e9
+                    << std::setw(10) << std::setprecision(2) << attainable/1e9
+                    << std::setw(10) << std::setprecision(1) << 100.*achieved/attainable
+                    << std::setw(10) << bound << "\n";
+                if (csv.is_open()) {
+                    csv << std::setprecision(9) << std::defaultfloat
+                        << n << "," << r.edges << "," << r.name << "," << r.seconds << ","
+                        << r.bytes << "," << r.flops << "," << intensity << ","
+                        << r.bytes/r.seconds/1e9 << "," << achieved/1e9 << "," << attainable/1e9 << ","
+                        << 100.*achieved/attainable << "," << bound << "\n";
+                }
+            }
+        }
+    }
+
+    return pool.exit();
+}
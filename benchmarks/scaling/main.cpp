@@ -0,0 +1,318 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Strong and weak scaling benchmark run
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#include <fvhyper/mesh.h>
+#include <fvhyper/explicit.h>
+#include <fvhyper/parallel.h>
+#include <fvhyper/post.h>
+#include <fvhyper/timers.h>
+
+#include <fstream>
+#include <iomanip>
+
+
+/*
+    One run of the scaling benchmark, driven by scaling.sh: a fixed number
+    of steps of the euler equations with the Roe flux on a generated mesh,
+    a density and pressure jump in a closed box. Usage:
+
+        mpirun -n p ./main --nx 256 --ny 256 [--steps 100] [--tri]
+                           [--label strong] [--out scaling.csv]
+
+    Rank 0 appends one csv row with the mean step time of the slowest rank,
+    the time per step in update_comms and in the rest of the step
+    (computation and the residual and time step reductions), and the halo
+    of the partitions: ghost cells and bytes sent by update_comms per step.
+*/
+namespace fvhyper {
+
+
+    // Define global constants
+    const int vars = 4;
+    const std::vector<std::string> var_names = {
+        "rho",
+        "rhou",
+        "rhov",
+        "rhoe"
+    };
+    namespace solver {
+        const bool do_calc_gradients = true;
+        const bool do_calc_limiters = true;
+        const bool linear_interpolate = true;
+        const bool diffusive_gradients = false;
+        const bool global_dt = false;
+        const bool smooth_residuals = true;
+    }
+
+    namespace consts {
+        double gamma = 1.4;
+        double cfl = 1.0;
+    }
+
+    inline double calc_p(const double* q) {
+        return (consts::gamma - 1)*(q[3] - 0.5/q[0]*(q[1]*q[1] + q[2]*q[2]));
+    }
+
+    /*
+        Define initial solution
+        A density and pressure jump at x = 0.5 over a wavy flow, so the
+        limiters take all their branches
+    */
+    void generate_initial_solution(
+        std::vector<double>& v,
+        const mesh& m
+    ) {
+        for (uint i=0; i<m.cellsAreas.size(); ++i) {
+            const double x = m.cellsCentersX[i];
+            const double y = m.cellsCentersY[i];
+            const double rho = (x < 0.5) ? 1.4 : 1.0;
+            const double p = (x < 0.5) ? 1.0 : 0.8;
+            const double u = 0.5 + 0.1*sin(6.283185307*y);
+            const double w = 0.1*sin(6.283185307*x);
+            v[4*i] = rho;
+            v[4*i+1] = rho*u;
+            v[4*i+2] = rho*w;
+            v[4*i+3] = p/(consts::gamma-1) + 0.5*rho*(u*u + w*w);
+        }
+    }
+
+    // Michalak limiter function
+    double limiter_func(const double& y) {
+        const double yt = 2.0;
+        if (y >= yt) {
+            return 1.0;
+        } else {
+            const double a = 1.0/(yt*yt) - 2.0/(yt*yt*yt);
+            const double b = -3.0/2.0*a*yt - 0.5/yt;
+            return a*y*y*y + b*y*y + y;
+        }
+    }
+
+    /*
+        Define flux function for the euler equations
+        Roe flux vector differencing
+    */
+    void calc_flux(
+        double* f,
+        const double* qi,
+        const double* qj,
+        const double* gx,
+        const double* gy,
+        const double* n
+    ) {
+
+        // Central flux
+        double pi, pj, Vi, Vj;
+        pi = (consts::gamma - 1)*(qi[3] - 0.5/qi[0]*(qi[1]*qi[1] + qi[2]*qi[2]));
+        pj = (consts::gamma - 1)*(qj[3] - 0.5/qj[0]*(qj[1]*qj[1] + qj[2]*qj[2]));
+        Vi = (qi[1]*n[0] + qi[2]*n[1])/qi[0];
+        Vj = (qj[1]*n[0] + qj[2]*n[1])/qj[0];
+
+        f[0] = qi[0]*Vi;
+        f[1] = qi[1]*Vi + pi*n[0];
+        f[2] = qi[2]*Vi + pi*n[1];
+        f[3] = (qi[3] + pi)*Vi;
+
+        f[0] += qj[0]*Vj;
+        f[1] += qj[1]*Vj + pj*n[0];
+        f[2] += qj[2]*Vj + pj*n[1];
+        f[3] += (qj[3] + pj)*Vj;
+
+        for (uint i=0; i<4; ++i) f[i] *= 0.5;
+
+        // Upwind flux
+        const double pL = pi;
+        const double pR = pj;
+
+        // Roe variables
+        const double uL = qi[1]/qi[0];
+        const double uR = qj[1]/qj[0];
+        const double vL = qi[2]/qi[0];
+        const double vR = qj[2]/qj[0];
+
+        const double srhoL = sqrt(qi[0]);
+        const double srhoR = sqrt(qj[0]);
+        const double rho = srhoR*srhoL;
+        const double u = (uL*srhoL + uR*srhoR)/(srhoL + srhoR);
+        const double v = (vL*srhoL + vR*srhoR)/(srhoL + srhoR);
+        const double h = ((qi[3] + pL)/qi[0]*srhoL + (qj[3] + pR)/qj[0]*srhoR)/(srhoL + srhoR);
+        const double q2 = u*u + v*v;
+        const double c = sqrt( (consts::gamma - 1.) * (h - 0.5*q2) );
+        const double V = u*n[0] + v*n[1];
+        const double VR = uR*n[0] + vR*n[1];
+        const double VL = uL*n[0] + vL*n[1];
+
+        // Roe correction
+        const double lambda_cm = abs(std::min(V-c, VL-c));
+        const double lambda_c  = abs(V);
+        const double lambda_cp = abs(std::max(V+c, VR+c));
+
+        const double kF1 = lambda_cm*((pR-pL) - rho*c*(VR-VL))/(2.*c*c);
+        const double kF234_0 = lambda_c*((qj[0] - qi[0]) - (pR-pL)/(c*c));
+        const double kF234_1 = lambda_c*rho;
+        const double kF5 = lambda_cp*((pR-pL) + rho*c*(VR-VL))/(2*c*c);
+
+        // Roe flux
+        f[0] -= 0.5*(kF1            + kF234_0                                                       + kF5);
+        f[1] -= 0.5*(kF1*(u-c*n[0]) + kF234_0*u      + kF234_1*(uR - uL - (VR-VL)*n[0])             + kF5*(u+c*n[0]));
+        f[2] -= 0.5*(kF1*(v-c*n[1]) + kF234_0*v      + kF234_1*(vR - vL - (VR-VL)*n[1])             + kF5*(v+c*n[1]));
+        f[3] -= 0.5*(kF1*(h-c*V)    + kF234_0*q2*0.5 + kF234_1*(u*(uR-uL) + v*(vR-vL) - V*(VR-VL))  + kF5*(h+c*V)); 
+    }
+
+    /*
+        Define the time step, local with the cfl number
+    */
+    void calc_dt(
+        std::vector<double>& dt,
+        const std::vector<double>& q,
+        mesh& m
+    ) {
+        for (uint i=0; i<dt.size(); ++i) {
+            dt[i] = 1.0;
+        }
+        for (uint e=0; e<m.edgesNodes.cols(); ++e) {
+            const auto& i = m.edgesCells(e, 0);
+            const auto& j = m.edgesCells(e, 1);
+            const auto& le = m.edgesLengths[e];
+            const double* qi = &q[4*i];
+            const double* qj = &q[4*j];
+            const double ci = sqrt(calc_p(qi)*consts::gamma / qi[0]);
+            const double cj = sqrt(calc_p(qj)*consts::gamma / qj[0]);
+            const double vi = abs((qi[1]*m.edgesNormalsX[e] + qi[2]*m.edgesNormalsY[e])/qi[0]) + ci;
+            const double vj = abs((qj[1]*m.edgesNormalsX[e] + qj[2]*m.edgesNormalsY[e])/qj[0]) + cj;
+            const double dt_i = consts::cfl * (m.cellsAreas[i] / le) / vi;
+            const double dt_j = consts::cfl * (m.cellsAreas[j] / le) / vj;
+            for (uint k=0; k<vars; ++k) {
+                dt[vars*i + k] = std::min(dt[vars*i + k], dt_i);
+                dt[vars*j + k] = std::min(dt[vars*j + k], dt_j);
+            }
+        }
+    }
+
+
+    namespace boundaries {
+
+        void wall(double* b, double* q, double* n) {
+            // Flip velocity, doesn't change norm of velocity
+            b[0] = q[0];
+            b[1] = q[1] - 2.0 * n[0] * (n[0]*q[1] + n[1]*q[2]);
+            b[2] = q[2] - 2.0 * n[1] * (n[0]*q[1] + n[1]*q[2]);
+            b[3] = q[3];
+        }
+        std::map<std::string, void (*)(double*, double*, double*)> 
+        bounds = {
+            {"bottom", wall},
+            {"right", wall},
+            {"top", wall},
+            {"left", wall}
+        };
+    }
+
+
+    namespace post {
+        std::map<std::string, void (*)(double*, double*)> 
+            extra_scalars = {};
+        
+        std::map<std::string, void (*)(double*, double*)> 
+            extra_vectors = {};
+    }
+
+
+}
+
+
+
+
+
+
+int main(int argc, char** argv) {
+    fvhyper::mpi_wrapper pool;
+
+    fvhyper::generatorOptions gen;
+    gen.nx = 256;
+    gen.ny = 256;
+    uint steps = 100;
+    std::string label = "run";
+    std::string out_file = "scaling.csv";
+
+    for (int a=1; a<argc; ++a) {
+        const std::string arg = argv[a];
+        const bool has_value = (a + 1) < argc;
+        if (arg == "--tri") {
+            gen.triangles = true;
+        } else if ((arg == "--nx") && has_value) {
+            gen.nx = std::stoi(argv[++a]);
+        } else if ((arg == "--ny") && has_value) {
+            gen.ny = std::stoi(argv[++a]);
+        } else if ((arg == "--steps") && has_value) {
+            steps = std::stoi(argv[++a]);
+        } else if ((arg == "--label") && has_value) {
+            label = argv[++a];
+        } else if ((arg == "--out") && has_value) {
+            out_file = argv[++a];
+        } else {
+            if (pool.rank == 0) {
+                std::cout << "Unknown argument " << arg << "\n";
+                std::cout << "Usage: main --nx n --ny n [--steps n] [--tri] [--label s] [--out file]\n";
+            }
+            return pool.exit();
+        }
+    }
+
+    fvhyper::mesh m;
+    m.generate(gen, pool);
+
+    fvhyper::solverOptions options;
+    options.max_step = steps;
+    options.tolerance = 0.;
+    options.verbose = false;
+    options.print_interval = steps + 1;
+
+    std::vector<double> q;
+    fvhyper::run("scaling", q, pool, m, options);
+
+    // Per rank measurements per step, then their sum and max over the ranks
+    namespace timers = fvhyper::timers;
+    const double comms = timers::totals[timers::update_comms].seconds;
+    double local[5];
+    local[0] = timers::totals[timers::step].seconds/steps;
+    local[1] = (timers::totals[timers::step].seconds - comms)/steps;
+    local[2] = comms/steps;
+    local[3] = m.ghostCellsOriginalIndices.size();
+    local[4] = ((double) timers::totals[timers::update_comms].bytes)/steps;
+    double sum[5];
+    double max[5];
+    MPI_Reduce(local, sum, 5, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(local, max, 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    if (pool.rank == 0) {
+        const bool header = !std::ifstream(out_file).good();
+        std::ofstream out(out_file, std::ios::app);
+        if (header) {
+            out << "label,ranks,cells,steps,step_s,compute_max_s,compute_avg_s,comms_max_s,comms_avg_s,"
+                << "halo_cells,halo_cells_max,halo_bytes_per_step,halo_bytes_per_step_max\n";
+        }
+        const double cells = (double) gen.nx*gen.ny*(gen.triangles ? 2 : 1);
+        out << std::setprecision(9)
+            << label << "," << pool.size << "," << cells << "," << steps << ","
+            << max[0] << "," << max[1] << "," << sum[1]/pool.size << ","
+            << max[2] << "," << sum[2]/pool.size << ","
+            << sum[3] << "," << max[3] << "," << sum[4] << "," << max[4] << "\n";
+        std::cout << label << ": " << pool.size << " ranks, " << cells << " cells, "
+            << max[0] << " s/step, update_comms " << max[2] << " s/step\n";
+    }
+
+    return pool.exit();
+}
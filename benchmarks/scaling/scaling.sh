@@ -0,0 +1,82 @@
+#! /bin/bash
+
+# Strong and weak scaling of the solver on generated meshes, for 1 to n ranks
+#   strong : the same n_strong x n_strong mesh on every rank count
+#   weak   : n_weak x n_weak cells per rank, the mesh grows along x
+# Times are per step. Ranks are oversubscribed when there are more ranks than
+# cores, with --oversubscribe for Open MPI and by default for MPICH, set MPIRUN
+# to change the launcher. Build main with make first.
+#
+#   ./scaling.sh [-n max_ranks] [-s steps] [-c n_strong] [-w n_weak] [-t] [-o dir]
+
+max_ranks=4
+steps=50
+n_strong=256
+n_weak=128
+tri=""
+out=results
+
+while getopts n:s:c:w:to: flag
+do
+    case "${flag}" in
+        n) max_ranks=${OPTARG};;
+        s) steps=${OPTARG};;
+        c) n_strong=${OPTARG};;
+        w) n_weak=${OPTARG};;
+        t) tri="--tri";;
+        o) out=${OPTARG};;
+        *) exit 1;;
+    esac
+done
+
+# --oversubscribe is an Open MPI option, other launchers do not accept it
+if [ -z "$MPIRUN" ]; then
+    if mpirun --version 2>&1 | grep -q "Open MPI"; then
+        MPIRUN="mpirun --oversubscribe"
+    else
+        MPIRUN="mpirun"
+    fi
+fi
+
+# Powers of two, and max_ranks
+ranks=""
+p=1
+while [ $p -lt $max_ranks ]; do
+    ranks="$ranks $p"
+    p=$((p*2))
+done
+ranks="$ranks $max_ranks"
+
+mkdir -p $out
+csv=$out/scaling.csv
+rm -f $csv
+
+for p in $ranks; do
+    $MPIRUN -n $p ./main --nx $n_strong --ny $n_strong --steps $steps $tri --label strong --out $csv || exit 1
+    $MPIRUN -n $p ./main --nx $((n_weak*p)) --ny $n_weak --steps $steps $tri --label weak --out $csv || exit 1
+done
+
+# Efficiency tables, relative to the single rank runs
+awk -F, '
+NR == 1 { next }
+$1 == "strong" && $2 == 1 { t1 = $5 }
+$1 == "strong" {
+    if (!strong++) {
+        print "\nStrong scaling, " $3 " cells, " $4 " steps"
+        printf "%6s %12s %10s %10s %12s %12s %14s\n", "Ranks", "Step (s)", "Speedup", "Eff. %", "Comms %", "Halo cells", "Halo KB/step"
+    }
+    printf "%6d %12.4f %10.2f %10.1f %12.1f %12d %14.1f\n", $2, $5, t1/$5, 100*t1/($2*$5), 100*$8/$5, $10, $12/1024
+}
+' $csv | tee $out/strong.txt
+
+awk -F, '
+NR == 1 { next }
+$1 == "weak" && $2 == 1 { t1 = $5 }
+$1 == "weak" {
+    if (!weak++) {
+        print "\nWeak scaling, " $3/$2 " cells per rank, " $4 " steps"
+        printf "%6s %12s %12s %10s %12s %12s %14s\n", "Ranks", "Cells", "Step (s)", "Eff. %", "Comms %", "Halo cells", "Halo KB/step"
+    }
+    printf "%6d %12d %12.4f %10.1f %12.1f %12d %14.1f\n", $2, $3, $5, 100*t1/$5, 100*$8/$5, $10, $12/1024
+}
+' $csv | tee $out/weak.txt
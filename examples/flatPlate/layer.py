@@ -1,6 +1,7 @@
 import pandas as pd
 import matplotlib.pyplot as plt
 import numpy as np
+import os
 
 
 
@@ -67,14 +68,21 @@ cp = 1
 
 x = 0.8
 
-data = pd.read_csv("layer.csv")
+if os.path.exists("layer_monitor.csv"):
+    # Line monitor output of main.cpp, last sampled step
+    data = pd.read_csv("layer_monitor.csv")
+    data = data[data["step"] == data["step"].max()]
+    y_in = data["y"]
+    u_in = data["rhou"] / data["rho"]
+else:
+    # ParaView export
+    data = pd.read_csv("layer.csv")
+    y_in = data["Points_1"]
+    u_in = data["U_0"]
 rho = data["rho"]
 
 nu = mu/rho
 
-y_in = data["Points_1"]
-u_in = data["U_0"]
-
 U = np.max(u_in)
 
 n = y_in * np.sqrt(U/(x*nu))
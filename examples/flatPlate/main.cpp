@@ -2,6 +2,7 @@
 #include <fvhyper/explicit.h>
 #include <fvhyper/parallel.h>
 #include <fvhyper/post.h>
+#include <fvhyper/monitor.h>
 
 /*
     Implementation of the flat plate laminar boundary layer using fvhyper
@@ -277,6 +278,18 @@ namespace fvhyper {
     }
 
 
+    /*
+        Spectral radii of the flux jacobians, used by the line-implicit smoother
+    */
+    double spectral_radius(const double* q, const double* n) {
+        const double c = sqrt(calc_p(q)*consts::gamma / q[0]);
+        return abs((q[1]*n[0] + q[2]*n[1])/q[0]) + c;
+    }
+    double viscous_spectral_radius(const double* q) {
+        return std::max(4./(3.*q[0]), consts::gamma/q[0]) * (consts::mu/consts::pr);
+    }
+
+
     namespace boundaries {
 
         /*
@@ -390,6 +403,17 @@ namespace fvhyper {
             p[0] = calc_p(q);
         }
 
+        void calc_surface_cf(double* cf, double* q, double* n, double d) {
+            // Skin friction coefficient from the tangential velocity of
+            //  the wall cell, against the free stream
+            const double ut = (-q[1]*n[1] + q[2]*n[0]) / q[0];
+            cf[0] = consts::mu * ut / d / (0.5*1.4*0.2*0.2);
+        }
+
+        void calc_surface_cp(double* cp, double* q, double* n, double d) {
+            cp[0] = (calc_p(q) - 1.0) / (0.5*1.4*0.2*0.2);
+        }
+
         std::map<std::string, void (*)(double*, double*)> 
         extra_scalars = {
             {"p", calc_output_p}
@@ -431,6 +455,24 @@ int main() {
     options.print_interval = 20;
     options.tolerance = 1e-20;
 
+    // Line-implicit smoothing along the boundary layer cells, uncomment it
+    //  with consts::cfl = 8 to converge in far fewer steps
+    // options.line_implicit = true;
+    options.spectral_radius = fvhyper::spectral_radius;
+    options.viscous_spectral_radius = fvhyper::viscous_spectral_radius;
+
+    // Boundary layer profile at x = 0.8, compared to Blasius by layer.py,
+    //  layer.csv being the ParaView reference profile
+    fvhyper::line_monitor layer;
+    layer.filename = "layer_monitor.csv";
+    layer.x0 = 0.8;
+    layer.y0 = 0.;
+    layer.x1 = 0.8;
+    layer.y1 = 0.075;
+    layer.points = 1001;
+    layer.interval = 1000;
+    options.monitors.push_back(&layer);
+
     // Run solver
     std::vector<double> q;
     fvhyper::run(name, q, pool, m, options);
@@ -438,6 +480,14 @@ int main() {
     // Save file
     fvhyper::writeVtk(name, q, m, pool.rank, pool.size);
 
+    // Wall distributions in square_surface.csv
+    fvhyper::writeSurface(
+        name + "_surface", q, m, pool, {"bot0", "bot1"}, {
+            {"cf", fvhyper::post::calc_surface_cf},
+            {"cp", fvhyper::post::calc_surface_cp}
+        }
+    );
+
     return pool.exit();
 }
 
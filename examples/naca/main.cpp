@@ -2,6 +2,7 @@
 #include <fvhyper/explicit.h>
 #include <fvhyper/parallel.h>
 #include <fvhyper/post.h>
+#include <fvhyper/monitor.h>
 
 
 /*
@@ -288,6 +289,11 @@ namespace fvhyper {
             p[0] = calc_p(q);
         }
 
+        void calc_surface_cp(double* cp, double* q, double* n, double d) {
+            // Pressure coefficient against the free stream
+            cp[0] = (calc_p(q) - 1.0) / (0.5*1.4*(0.8*0.8 + 0.0175*0.0175));
+        }
+
         std::map<std::string, void (*)(double*, double*)> 
             extra_scalars = {
                 {"p", calc_output_p}
@@ -331,6 +337,22 @@ int main() {
     options.print_interval = 10;
     options.tolerance = 1e-6;
 
+    // Residual smoothing, for cfl above the explicit limit of ~2: uncomment
+    //  with solver::smooth_residuals = true and consts::cfl = 3
+    // options.smooth_cfl_ratio = fvhyper::consts::cfl / 2.0;
+
+    // Lift, drag and quarter chord moment in forces.csv, stop when the
+    //  coefficients settle to 1e-4 over the last 200 steps
+    fvhyper::force_monitor forces;
+    forces.boundaries = {"airfoil"};
+    forces.interval = 10;
+    forces.reference_pressure = 0.5*1.4*(0.8*0.8 + 0.0175*0.0175);
+    forces.alpha = atan2(0.0175, 0.8);
+    forces.moment_x = 0.25;
+    forces.tolerance = 1e-4;
+    forces.window = 20;
+    options.monitors.push_back(&forces);
+
     // Run solver
     std::vector<double> q;
     fvhyper::run(name, q, pool, m, options);
@@ -338,6 +360,11 @@ int main() {
     // Save file
     fvhyper::writeVtk(name, q, m, pool.rank, pool.size);
 
+    // Pressure distribution on the airfoil in naca_surface.csv
+    fvhyper::writeSurface(
+        name + "_surface", q, m, pool, {"airfoil"}, {{"cp", fvhyper::post::calc_surface_cp}}
+    );
+
     return pool.exit();
 }
 
@@ -0,0 +1,65 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Convergence acceleration header
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#pragma once
+
+#include <fvhyper/mesh.h>
+#include <fvhyper/parallel.h>
+#include <vector>
+
+
+namespace fvhyper {
+
+
+extern const int vars;
+
+
+/*
+    Anderson acceleration of the pseudo-time iteration q <- G(q)
+    Keeps the last depth differences of the iterates and of the fixed point
+    residuals f = G(q) - q, and extrapolates
+        q <- G(q) - dG gamma,   gamma = argmin |f - dF gamma|
+    The history is reset when |f| grows by more than safeguard.
+*/
+class anderson_accelerator {
+public:
+    uint depth;
+    double safeguard;
+    double regularization = 1e-10;
+
+    std::vector<double> x;      // iterate before the step
+    std::vector<double> f;
+    std::vector<double> f_old;
+    std::vector<double> g_old;
+    std::vector<std::vector<double>> dF;
+    std::vector<std::vector<double>> dG;
+
+    uint n_stored = 0;
+    uint newest = 0;
+    double f_norm_old = -1.;
+    uint resets = 0;
+
+    void init(const uint depth_in, const double safeguard_in, const uint size);
+
+    // Store the iterate before a step
+    void begin(const std::vector<double>& q);
+
+    // Replace q = G(x) with the extrapolated iterate
+    void extrapolate(std::vector<double>& q, mesh& m);
+};
+
+
+
+}
@@ -0,0 +1,72 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Partition balance header
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#pragma once
+
+#include <fvhyper/mesh.h>
+#include <fvhyper/parallel.h>
+#include <chrono>
+#include <vector>
+
+
+namespace fvhyper {
+
+
+/*
+    Load balance of the mesh partition
+    measure() counts the cells, edges, neighbors and halo of this rank,
+    print_partition() gathers them and prints the min/avg/max over the
+    ranks, the max/avg imbalance ratio and the ranks holding the largest
+    values. print_waits() then reports the time each rank spent blocked
+    in messages and barriers since start(), from the phase timers, to see
+    if the imbalance actually costs anything at run time.
+*/
+namespace balance {
+
+    enum stat {
+        owned_cells,
+        ghost_cells,        // copies of the cells of neighbor ranks
+        boundary_cells,
+        edges,
+        boundary_edges,
+        neighbors,
+        halo_send_bytes,    // per exchange of one double per variable
+        halo_recv_bytes,
+        n_stats
+    };
+
+    extern const char* stat_names[n_stats];
+
+    class report {
+    public:
+        double stats[n_stats];
+        std::chrono::steady_clock::time_point begin;
+
+        void measure(const mesh& m);
+
+        // Collective, rank 0 prints
+        void print_partition(mpi_wrapper& pool, const uint worst = 3) const;
+
+        // Start of the timed steps, after timers::reset()
+        void start();
+
+        // Collective, rank 0 prints the compute and wait times since start()
+        void print_waits(const uint steps, mpi_wrapper& pool, const uint worst = 3) const;
+    };
+}
+
+
+
+}
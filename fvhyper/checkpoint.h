@@ -0,0 +1,80 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Checkpoint and restart header
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#pragma once
+
+#include <fvhyper/mesh.h>
+#include <fvhyper/parallel.h>
+#include <string>
+#include <vector>
+
+
+namespace fvhyper {
+
+
+extern const int vars;
+
+
+/*
+    Solver state saved with the solution, enough to resume the iterations
+    where they stopped
+*/
+class checkpoint_state {
+public:
+    uint step = 0;
+    double time = 0.;
+    std::vector<double> R0;     // residuals of the first step
+    std::vector<double> R;      // last relative residuals
+    double save_time = 0.;      // time of the next time series output
+    uint time_step = 0;         // index of the next time series output
+};
+
+
+/*
+    Parallel checkpoint of the solution and solver state
+    The owned cells are stored at their original mesh index, so a restart
+    does not depend on the partitioning or local numbering. Every rank
+    writes its cells in a single collective MPI-IO call through a file
+    view indexed by the original indices. The file is written under a
+    temporary name and renamed once complete, so an interrupted write
+    never replaces the previous checkpoint.
+*/
+void write_checkpoint(
+    const std::string filename,
+    std::vector<double>& q,
+    mesh& m,
+    mpi_wrapper& pool,
+    const checkpoint_state& state
+);
+
+// Read q on the owned cells and the solver state, partition ghosts are not set
+void read_checkpoint(
+    const std::string filename,
+    std::vector<double>& q,
+    mesh& m,
+    mpi_wrapper& pool,
+    checkpoint_state& state
+);
+
+
+// Record SIGTERM instead of terminating
+void catch_sigterm();
+
+// True on every rank once any rank received SIGTERM, collective
+bool sigterm_received(mpi_wrapper& pool);
+
+
+
+}
@@ -0,0 +1,72 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Hardware counters header
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+
+namespace fvhyper {
+
+
+/*
+    Hardware performance counters of the solver thread
+    start() opens a group of Linux perf_event_open counters on the calling
+    thread, user space only. Events the cpu does not support are left out
+    of the group, and when none can be opened (no PMU in a virtual machine,
+    perf_event_paranoid > 2, not Linux) the counters stay disabled and
+    error tells why. read() costs a single system call, the scoped timers
+    of timers.h read the group on entry and exit of each phase.
+*/
+namespace counters {
+
+    enum event {
+        cycles,
+        instructions,
+        llc_misses,
+        branch_misses,
+        n_events
+    };
+
+    extern const char* event_names[n_events];
+
+    struct counter_group {
+        int leader = -1;            // file descriptor of the group, -1 when disabled
+        int fds[n_events];
+        int slots[n_events];        // position of the event in a group read, -1 if not counted
+        int n = 0;                  // events in the group
+        std::string error;
+    };
+
+    extern counter_group group;
+
+    inline bool enabled() {return group.leader >= 0;}
+
+    inline bool counted(const event e) {return enabled() && (group.slots[e] >= 0);}
+
+    // Counts since start(), zero for the events not counted
+    void read(uint64_t values[n_events]);
+
+    // Open the counters of the calling thread, false and error set when unavailable
+    bool start();
+
+    // Close the counters, true if the events were multiplexed with others
+    bool stop();
+}
+
+
+
+}
@@ -42,14 +42,6 @@ namespace solver {
 }
 
 
-void smooth_residuals(
-    std::vector<double>& qt_,
-    std::vector<double>& smoother_qt,
-    std::vector<double>& smoother,
-    mesh& m
-);
-
-
 double limiter_func(const double& r);
 
 
@@ -89,16 +81,18 @@ void calc_gradients(
     std::vector<double>& gx,
     std::vector<double>& gy,
     const std::vector<double>& q,
-    const mesh& m
+    mesh& m
 );
 
 
 void calc_limiters(
     std::vector<double>& limiters,
+    std::vector<double>& qmin,
+    std::vector<double>& qmax,
     const std::vector<double>& q,
     const std::vector<double>& gx,
     const std::vector<double>& gy,
-    const mesh& m
+    mesh& m
 );
 
 
@@ -112,6 +106,17 @@ void calc_time_derivatives(
 );
 
 
+void calc_edge_flux(
+    double* f,
+    const uint e,
+    const std::vector<double>& q,
+    const std::vector<double>& gx,
+    const std::vector<double>& gy,
+    const std::vector<double>& limiters,
+    mesh& m
+);
+
+
 void update_cells(
     std::vector<double>& q,
     std::vector<double>& ql,
@@ -120,6 +125,17 @@ void update_cells(
     const double v
 );
 
+// Same update, also adding the squared residuals of the real cells to R
+void update_cells(
+    std::vector<double>& q,
+    std::vector<double>& ql,
+    const std::vector<double>& qt,
+    const std::vector<double>& dt,
+    const double v,
+    const mesh& m,
+    std::vector<double>& R
+);
+
 void update_bounds(
     std::vector<double>& q,
     std::vector<double>& gx,
@@ -142,6 +158,41 @@ void calc_residuals(
     mpi_wrapper& pool
 );
 
+void accumulate_residuals(
+    std::vector<double>& R,
+    const std::vector<double>& qt,
+    const mesh& m
+);
+
+
+/*
+    Residual norms reduced without blocking the iterations
+    The squared residuals of a step are summed in sums while its last
+    stage updates the cells, post() then starts their MPI_Iallreduce and
+    complete() waits for it one step later, when the messages of that
+    step have usually carried it through. Convergence is thus tested one
+    step late.
+*/
+class residual_reduction {
+public:
+    std::vector<double> sums;       // local squared residuals of the current step
+    std::vector<double> posted;     // copy of sums being reduced, sums is free for the next step
+    std::vector<double> reduced;    // sums over the ranks of the posted step
+    MPI_Request request = MPI_REQUEST_NULL;
+    bool pending = false;
+
+    // Step, time and elapsed seconds of the posted step
+    uint step;
+    double time;
+    double seconds;
+
+    void clear();
+    void post(const uint step_, const double time_, const double seconds_);
+
+    // Wait for the posted step and write its norms in R, false if none posted
+    bool complete(double* R);
+};
+
 
 void min_dt(std::vector<double>& dt, mesh& m);
 
@@ -149,6 +200,9 @@ void min_dt(std::vector<double>& dt, mesh& m);
 void validate_dt(std::vector<double>& dt, mpi_wrapper& pool);
 
 
+class monitor;
+
+
 struct solverOptions {
     double max_time = 1e10;
     uint max_step = 1e8;
@@ -157,8 +211,85 @@ struct solverOptions {
     double tolerance = 1e-16;
     bool save_time_series = false;
     double time_series_interval = 0.2;
+    bool vtk_float64 = false;   // Float64 instead of Float32 vtu data
+    int vtk_compression = 0;    // zlib level of the vtu or native snapshot data
+    std::map<std::string, double> vtk_tolerances;   // absolute error bound of named arrays
+    bool native_time_series = false;    // compressed q snapshots, see write_snapshot
+    bool async_output = true;   // time series written by a background thread
+    bool xdmf_time_series = false;  // geometry written once, fields per snapshot in name.xmf
+    bool collective_output = false; // one vtu per snapshot for all ranks, with MPI-IO, needs global_dt
+    bool vtk_point_data = false;    // node interpolated fields in the vtu snapshots, needs global_dt
+
+    // Implicit residual smoothing, used if solver::smooth_residuals
+    //  epsilon = max(0, ((cfl/cfl*)^2 - 1)/4) if smooth_cfl_ratio = cfl/cfl* > 0
+    uint smooth_iters = 2;
+    double smooth_epsilon = 0.6;
+    double smooth_cfl_ratio = 0.;
+    bool smooth_exchange = false;   // exchange qt between sweeps, independent of the rank count
+
+    // Spectral radius callbacks for the implicit smoothers and solvers
+    //  spectral_radius(q, n) : max eigenvalue of the convective flux jacobian
+    //  viscous_spectral_radius(q) : max diffusivity (optional)
+    double (*spectral_radius)(const double*, const double*) = nullptr;
+    double (*viscous_spectral_radius)(const double*) = nullptr;
+
+    // Line-implicit smoothing along stretched cells
+    bool line_implicit = false;
+    double line_min_aspect = 4.;
+    std::vector<std::string> line_walls;    // boundaries lines start from, all if empty
+
+    // LU-SGS implicit iterations instead of the RK5 stages
+    bool lusgs = false;
+    uint lusgs_sweeps = 1;  // symmetric forward/backward sweep pairs per step
+
+    // Anderson acceleration over the last anderson_depth iterates, 0 to disable
+    uint anderson_depth = 0;
+    uint anderson_start = 0;            // first accelerated step
+    double anderson_safeguard = 2.;     // history reset if |G(q) - q| grows by this factor
+
+    // In-situ monitors, see monitor.h, iterations stop when one converges
+    std::vector<monitor*> monitors;
+
+    // Checkpoint/restart, see checkpoint.h
+    std::string restart_file = "";      // start from this checkpoint instead of the initial solution
+    uint checkpoint_interval = 0;       // write name.chk every n steps, 0 to disable
+    bool checkpoint_on_sigterm = false; // write name.chk and stop on SIGTERM
+    uint sigterm_interval = 20;         // steps between the collective checks for SIGTERM
+
+    // Per-phase timers, see timers.h, printed and/or written as json at the end
+    bool print_timers = false;
+    std::string timers_file = "";
+
+    // Chrome trace of the timed phases and messages of every rank, see timers.h
+    std::string trace_file = "";
+    uint trace_events = 1 << 18;    // ring buffer capacity per rank
+
+    // Hardware counters of the timed phases, see counters.h, Linux only
+    bool hardware_counters = false;
+    std::string counters_file = "";
+
+    // Memory footprint of the mesh and solver structures, see memory.h
+    bool print_memory = false;
+    std::string memory_file = "";
+
+    // Partition balance at startup and exchange waits of the first steps, see balance.h
+    bool print_balance = false;
+    uint balance_steps = 20;
+
+    // Seconds between flushes of the buffered residual lines, 0 flushes every line
+    double log_flush_interval = 1.;
 };
 
+void smooth_residuals(
+    std::vector<double>& qt_,
+    std::vector<double>& smoother_qt,
+    std::vector<double>& smoother,
+    mesh& m,
+    mpi_wrapper& pool,
+    const solverOptions& opt
+);
+
+
 void complete_calc_qt(
     std::vector<double>& qt,
     std::vector<double>& q,
@@ -172,6 +303,57 @@ void complete_calc_qt(
 );
 
 
+/*
+    Residual operator qt = R(q), owning its work arrays
+    Full evaluations compute gradients and limiters, perturbed and partial
+    evaluations reuse those of the last full evaluation
+*/
+class residual_operator {
+public:
+    std::vector<double> qt;
+    std::vector<double> gx;
+    std::vector<double> gy;
+    std::vector<double> qmin;
+    std::vector<double> qmax;
+    std::vector<double> limiters;
+    std::vector<double> qp;
+
+    mesh* m;
+    mpi_wrapper* pool;
+
+    residual_operator(mesh& m_in, mpi_wrapper& pool_in);
+
+    // R(q)
+    std::vector<double>& operator()(std::vector<double>& q);
+
+    // Gradients and limiters of q, without the time derivatives
+    void reconstruct(std::vector<double>& q);
+
+    // R(q + eps*v), bounds and ghost cells of q + eps*v are updated
+    std::vector<double>& perturbed(
+        const std::vector<double>& q,
+        const std::vector<double>& v,
+        const double eps
+    );
+
+    // jv = (R(q + eps*v) - r)/eps, with r = R(q) stored outside of qt
+    void jacobian_vector(
+        std::vector<double>& jv,
+        const std::vector<double>& r,
+        const std::vector<double>& q,
+        const std::vector<double>& v,
+        const double eps
+    );
+
+    // R(q) in the given cells only, written to qt_out
+    void partial(
+        std::vector<double>& qt_out,
+        const std::vector<double>& q,
+        const std::vector<uint>& cells
+    );
+};
+
+
 void run(
     const std::string name,
     std::vector<double>& q,
@@ -0,0 +1,121 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Implicit smoothers header
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#pragma once
+
+#include <fvhyper/mesh.h>
+#include <fvhyper/explicit.h>
+#include <vector>
+#include <string>
+
+
+namespace fvhyper {
+
+
+extern const int vars;
+
+
+/*
+    Approximate spectral radius of the flux jacobian on edge e, from the
+    user convective and (optional) viscous spectral radius callbacks
+*/
+double face_spectral_radius(
+    const uint e,
+    const std::vector<double>& q,
+    mesh& m,
+    double (*spectral_radius)(const double*, const double*),
+    double (*viscous_spectral_radius)(const double*)
+);
+
+
+/*
+    Line-implicit smoother
+    Cells are grouped in lines following the strongest coupled neighbours
+    out from the walls. Along each line, the scalar dissipation jacobians
+    give a tridiagonal system solved with the Thomas algorithm. Cells that
+    are not part of a line are solved point implicitly.
+*/
+class line_smoother {
+public:
+    std::vector<uint> linesStart;   // CSR offsets of each line in linesCells
+    std::vector<uint> linesCells;   // cells of each line, from the wall outwards
+    std::vector<uint> linesEdges;   // edge between a line cell and the previous one
+
+    std::vector<double> diag;
+    std::vector<double> faceCoefs;
+    std::vector<double> cp;
+    std::vector<double> dp;
+
+    void make_lines(
+        mesh& m,
+        const std::vector<std::string>& walls,
+        const double min_aspect
+    );
+
+    void smooth(
+        std::vector<double>& qt,
+        const std::vector<double>& q,
+        const std::vector<double>& dt,
+        const double alpha,
+        mesh& m,
+        double (*spectral_radius)(const double*, const double*),
+        double (*viscous_spectral_radius)(const double*)
+    );
+
+    uint size() const;
+};
+
+
+
+/*
+    LU-SGS implicit solver
+    Symmetric Gauss-Seidel sweeps over a breadth first cell ordering, with
+    matrix free off-diagonal terms
+        1/2 l (F(q_j + dq_j).n - F(q_j).n - lambda dq_j)
+    where F(q).n is evaluated as calc_flux(q, q) and lambda is the face
+    spectral radius. Partition ghost cells are exchanged between sweeps.
+*/
+class lusgs_solver {
+public:
+    std::vector<uint> order;        // sweep order of the owned cells
+
+    std::vector<double> dq;
+    std::vector<double> diag;
+    std::vector<double> faceCoefs;
+    std::vector<double> faceFluxes;  // F(q).n of both edge cells, 2*vars per edge
+
+    void make_ordering(mesh& m);
+
+    void iterate(
+        std::vector<double>& q,
+        std::vector<double>& qt,
+        const std::vector<double>& dt,
+        mesh& m,
+        mpi_wrapper& pool,
+        const solverOptions& opt
+    );
+
+private:
+    void sweep_cell(
+        const uint i,
+        const std::vector<double>& q,
+        const std::vector<double>& qt,
+        mesh& m
+    );
+};
+
+
+
+}
@@ -0,0 +1,110 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Memory footprint header
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#pragma once
+
+#include <fvhyper/mesh.h>
+#include <fvhyper/parallel.h>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+
+namespace fvhyper {
+
+
+/*
+    Memory footprint of the mesh and solver structures
+    Bytes are the heap memory held by each container: vector capacities,
+    and map nodes with their glibc allocation overhead. The peak resident
+    set size of the process is taken after the setup and after the solve,
+    the difference with the accounted bytes is everything else (MPI
+    buffers, code, temporaries).
+*/
+namespace memory {
+
+    // Size of a glibc malloc chunk holding n bytes
+    inline uint64_t chunk(const uint64_t n) {
+        return std::max<uint64_t>(32, (n + 8 + 15) & ~((uint64_t) 15));
+    }
+
+    // Values without heap memory, containers need their own overload
+    template<class T>
+    uint64_t heap(const T&) {
+        static_assert(std::is_trivially_copyable<T>::value, "memory::heap has no overload for this type");
+        return 0;
+    }
+
+    inline uint64_t heap(const std::string& s) {
+        return (s.capacity() > 15) ? chunk(s.capacity() + 1) : 0;
+    }
+
+    template<class T>
+    uint64_t heap(const std::vector<T>& v) {
+        uint64_t b = v.capacity()*sizeof(T);
+        for (auto& x : v) b += heap(x);
+        return b;
+    }
+
+    inline uint64_t heap(const std::vector<bool>& v) {
+        return (v.capacity() + 63)/64*8;
+    }
+
+    template<class... T>
+    uint64_t heap(const std::tuple<T...>& t) {
+        return std::apply([](const T&... x) {return (uint64_t(0) + ... + heap(x));}, t);
+    }
+
+    template<class K, class V>
+    uint64_t heap(const std::map<K, V>& m) {
+        // Red-black tree nodes hold the color, three pointers and the value
+        uint64_t b = m.size()*chunk(32 + sizeof(typename std::map<K, V>::value_type));
+        for (auto& keyval : m) b += heap(keyval.first) + heap(keyval.second);
+        return b;
+    }
+
+    // Peak resident set size of the process, in bytes
+    uint64_t peak_rss();
+
+    struct entry {
+        std::string name;
+        uint64_t bytes;
+    };
+
+    class footprint {
+    public:
+        std::vector<entry> entries;
+        uint64_t setup_peak_rss = 0;
+        uint64_t solve_peak_rss = 0;
+
+        void add(const std::string name, const uint64_t bytes);
+
+        // Every container of the mesh, as mesh.<member>
+        void add_mesh(const mesh& m);
+
+        // Collective, rank 0 prints the avg/max per rank and total of each entry
+        void print(mpi_wrapper& pool) const;
+
+        // Collective, rank 0 writes the bytes of every rank and their avg/max
+        void write(const std::string filename, mpi_wrapper& pool) const;
+    };
+}
+
+
+
+}
@@ -61,6 +61,17 @@ public:
 };
 
 
+class mpi_comm_nodes {
+public:
+    std::vector<uint> snd_nodes;
+    std::vector<uint> rec_nodes;
+    std::vector<double> snd_q;
+    std::vector<double> rec_q;
+
+    uint out_rank;
+};
+
+
 template<uint N>
 class meshArray {
 private:
@@ -72,6 +83,7 @@ public:
     void push_back(const std::vector<uint> v);
     uint cols() const;
     uint rows() const;
+    size_t capacity() const;
     void dump();
     void swap(const uint& i, const uint& j);
     void move_to_end(const uint& i);
@@ -103,6 +115,9 @@ uint meshArray<N>::cols() const {return n;};
 template<uint N>
 uint meshArray<N>::rows() const {return N;};
 
+template<uint N>
+size_t meshArray<N>::capacity() const {return nodes.capacity();};
+
 template<uint N>
 void meshArray<N>::dump() {
     for (uint i=0; i<n; ++i) {
@@ -132,6 +147,24 @@ const std::vector<uint>& meshArray<N>::get_vector() {
 
 
 
+/*
+    Structured rectangle [0, lx] x [0, ly] of nx by ny quads, or of twice as
+    many triangles, generated in memory and partitioned in strips along x.
+    Boundaries are named bottom, right, top and left. Node jitter and random
+    cell and node numbering make it behave like an unstructured mesh.
+*/
+struct generatorOptions {
+    uint nx = 64;
+    uint ny = 64;
+    double lx = 1.;
+    double ly = 1.;
+    bool triangles = false;
+    double jitter = 0.;     // random node displacement, fraction of the cell size
+    bool shuffle = false;   // random cell and node numbering
+    uint seed = 1;
+};
+
+
 // Class for a partitionned mesh domain
 class mesh {
 public:
@@ -180,7 +213,15 @@ public:
 
     uint nRealCells;
 
+    std::vector<uint> cellsEdgesStart;  // CSR offsets of each cell in cellsEdges
+    std::vector<uint> cellsEdges;       // edges surrounding each cell
+
+    std::vector<uint> nodesCellsStart;      // CSR offsets of each node in nodesCells
+    std::vector<uint> nodesCells;           // real cells around each node, by original index
+    std::vector<double> nodesCellsWeights;  // inverse distance weights, summing to one per node
+
     std::vector<mpi_comm_cells> comms;
+    std::vector<mpi_comm_nodes> nodesComms; // nodes of partition ghost cells only, from their owners
 
     void read_entities();
     void read_nodes();
@@ -191,6 +232,8 @@ public:
     void add_boundary_cells();
 
     void read_file(std::string filename, mpi_wrapper& pool);
+    void generate(const generatorOptions& opt, mpi_wrapper& pool);
+    void build(mpi_wrapper& pool);
 
     void make_comms(uint rank);
 
@@ -201,6 +244,9 @@ public:
     void convert_node_face_info();
     void compute_mesh();
     void add_cell_edges(uint cell_id);
+    void compute_cells_edges();
+    void compute_nodes_cells();
+    void make_nodes_comms();
 
     void send_mesh_info();
 };
@@ -0,0 +1,185 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : In-situ monitors header
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#pragma once
+
+#include <fvhyper/mesh.h>
+#include <fvhyper/parallel.h>
+#include <fvhyper/search.h>
+#include <array>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+namespace fvhyper {
+
+
+extern const int vars;
+
+class residual_operator;
+
+
+/*
+    Monitor base class
+    run() calls update() every interval steps, after the solution update,
+    with the gradients and limiters of residual computed for q.
+    A monitor reporting converged() stops the iterations.
+*/
+class monitor {
+public:
+    uint interval = 1;
+    bool restarted = false;         // set by run() on a restart, files are appended to
+
+    virtual void init(mesh&, mpi_wrapper&) {}
+
+    virtual void update(
+        const uint step,
+        const double time,
+        std::vector<double>& q,
+        const residual_operator& residual,
+        mesh& m,
+        mpi_wrapper& pool
+    ) = 0;
+
+    virtual bool converged() const {return false;}
+
+    virtual void finish() {}
+
+    virtual ~monitor() {}
+};
+
+
+
+/*
+    Force and moment monitor
+    Integrates the numerical momentum flux through the boundary edges of
+    the named boundaries, which is the pressure and viscous force of the
+    fluid on the walls. The force, the moment about (moment_x, moment_y)
+    and the drag, lift and moment coefficients are appended to a csv file.
+*/
+class force_monitor : public monitor {
+public:
+    std::vector<std::string> boundaries;
+    std::string filename = "forces.csv";
+
+    uint momentum_x = 1;            // indices of the momentum variables in q
+    uint momentum_y = 2;
+
+    double reference_pressure = 1.; // dynamic pressure of the coefficients
+    double reference_length = 1.;
+    double alpha = 0.;              // angle of attack in radians
+    double moment_x = 0.;
+    double moment_y = 0.;
+
+    // Converged when the three coefficients vary by less than tolerance
+    //  over the last window updates, 0 to disable
+    double tolerance = 0.;
+    uint window = 50;
+
+    std::vector<uint> edges;        // monitored boundary edges of this rank
+    std::array<double, 3> loads;    // fx, fy, moment
+    std::array<double, 3> coefficients;     // cd, cl, cm
+    std::deque<std::array<double, 3>> history;
+
+    std::ofstream out;
+
+    void init(mesh& m, mpi_wrapper& pool) override;
+
+    void update(
+        const uint step,
+        const double time,
+        std::vector<double>& q,
+        const residual_operator& residual,
+        mesh& m,
+        mpi_wrapper& pool
+    ) override;
+
+    bool converged() const override;
+
+    void finish() override;
+};
+
+
+
+
+/*
+    Point probes
+    Each point is located once in the owned cells with a cell_locator and
+    sampled from its cell center value and gradient. Rank 0 gathers the
+    variables and post::extra_scalars of every point and appends them to
+    a csv file, one line per update.
+*/
+class probe_monitor : public monitor {
+public:
+    std::vector<double> x;
+    std::vector<double> y;
+    std::string filename = "probes.csv";
+
+    cell_locator locator;
+    std::vector<int> cells;         // cell of each point on this rank, -1 if not owned
+    std::vector<int> owners;        // rank of each point, world size if outside the mesh
+    std::vector<double> values;     // gathered samples, on rank 0
+    uint fields = 0;                // values per point
+
+    std::ofstream out;
+
+    void init(mesh& m, mpi_wrapper& pool) override;
+
+    void update(
+        const uint step,
+        const double time,
+        std::vector<double>& q,
+        const residual_operator& residual,
+        mesh& m,
+        mpi_wrapper& pool
+    ) override;
+
+    void finish() override;
+
+protected:
+    std::vector<std::string> field_names() const;
+    virtual void write_header();
+    virtual void write_values(const uint step, const double time);
+};
+
+
+
+/*
+    Line sample of points evenly spaced from (x0, y0) to (x1, y1)
+    Each update appends one line per point, with its distance s from
+    (x0, y0), to the csv file
+*/
+class line_monitor : public probe_monitor {
+public:
+    double x0 = 0.;
+    double y0 = 0.;
+    double x1 = 1.;
+    double y1 = 0.;
+    uint points = 100;
+
+    line_monitor();
+
+    void init(mesh& m, mpi_wrapper& pool) override;
+
+protected:
+    void write_header() override;
+    void write_values(const uint step, const double time) override;
+};
+
+
+
+}
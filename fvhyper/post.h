@@ -16,6 +16,18 @@
 #pragma once
 
 #include <fvhyper/mesh.h>
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 
 namespace fvhyper {
@@ -27,20 +39,302 @@ namespace post {
     
     extern std::map<std::string, 
         void (*)(double*, double*)> extra_vectors;
+
+
+    /*
+        Buffered binary output file
+        Values are copied in a fixed size buffer written to the file in
+        large chunks, blocks larger than the buffer are written directly.
+        Failed writes throw a std::runtime_error naming the file, call
+        close() to see the errors of the last chunk, the destructor
+        can not throw them.
+    */
+    class binary_writer {
+    public:
+        std::string filename;
+        std::ofstream out;
+        std::vector<char> buffer;
+        size_t used = 0;
+
+        binary_writer(const std::string filename, const size_t buffer_size = 1 << 22);
+        ~binary_writer();
+
+        void write(const void* data, const size_t bytes);
+        void write(const std::string& s);
+
+        template<typename T>
+        void put(const T v) {
+            write(&v, sizeof(T));
+        }
+
+        void flush();
+        void close();
+        void check();
+    };
+
+
+    /*
+        Zlib encoder of one vtu appended data array
+        Values are compressed in independent blocks, described by the vtk
+        compression header [blocks, block size, last block size, compressed
+        sizes...]
+    */
+    class zlib_encoder {
+    public:
+        int level;
+        size_t block_size;
+        std::vector<char> block;
+        std::vector<uint64_t> header;
+        std::vector<char> data;
+        uint64_t raw_bytes = 0;
+
+        zlib_encoder(const int level, const size_t block_size = 1 << 18);
+
+        void write(const void* values, const size_t bytes);
+
+        template<typename T>
+        void put(const T v) {
+            write(&v, sizeof(T));
+        }
+
+        void finish();
+        uint64_t size() const;
+
+    private:
+        void compress_block();
+    };
+
+
+    // Snapshot compression, tolerances are absolute error bounds of the
+    //  named arrays, which are stored exactly if absent
+    struct compression {
+        int level = 0;      // zlib level from 1 to 9, 0 for uncompressed vtu
+        std::map<std::string, double> tolerances;
+    };
+
+
+    struct output_stats {
+        uint64_t raw_bytes = 0;     // uncompressed size
+        uint64_t file_bytes = 0;
+        double seconds = 0.;
+    };
+
+
+    bool little_endian();
 }
 
 extern const std::vector<std::string> var_names;
 
 
-void writeVtk(
+/*
+    Node values of the variables, interpolated from the real cells around
+    each node with the mesh inverse distance weights. Nodes of partition
+    ghost cells only are received from their owners, so a node has the
+    same value on every rank. Collective when running in parallel.
+*/
+void interpolate_nodes(
+    std::vector<double>& qn,
+    std::vector<double>& q,
+    mesh& m
+);
+
+
+/*
+    Vtu output of the cell fields, with point_data the same fields are
+    also interpolated to the nodes, see interpolate_nodes
+*/
+post::output_stats writeVtk(
     const std::string name,
     std::vector<double>& q,
     mesh& m,
     int rank,
     int world_size,
-    const std::string time = ""
+    const std::string time = "",
+    const bool float64 = false,
+    const post::compression& compression = post::compression(),
+    const bool point_data = false
 );
 
-}
 
+/*
+    Single vtu file written collectively by all ranks with MPI-IO
+    Points are numbered by their original mesh node tags, shared nodes are
+    written once, and each rank writes its slab of the owned cells at the
+    offsets given by an exclusive scan of the cell counts
+*/
+void writeVtkCollective(
+    const std::string name,
+    std::vector<double>& q,
+    mesh& m,
+    mpi_wrapper& pool,
+    const std::string time = "",
+    const bool float64 = false
+);
+
+
+
+/*
+    Compressed native snapshot of q on the cells of one rank
+    Each variable is quantized to its tolerance if any, byte shuffled so
+    the bytes of equal significance are contiguous, then zlib compressed.
+    read_snapshot restores q on the same mesh partition.
+*/
+post::output_stats write_snapshot(
+    const std::string filename,
+    std::vector<double>& q,
+    mesh& m,
+    const bool float64 = false,
+    const post::compression& compression = post::compression()
+);
+
+void read_snapshot(
+    const std::string filename,
+    std::vector<double>& q,
+    mesh& m
+);
+
+
+
+/*
+    Surface distributions on named boundaries
+    For every owned boundary edge of the given physical names, writes the
+    edge center, outward unit normal and each surface quantity, evaluated
+    on the interior cell state as
+        f(value, q, n, d)
+    where d is the normal distance from the cell center to the edge, so
+    wall gradients such as skin friction can be approximated. Output is a
+    csv, or a raw binary table with binary, per rank or gathered on rank 0
+    with merged. The cost is proportional to the boundary edges only.
+*/
+typedef void (*surface_quantity)(double*, double*, double*, double);
+
+void writeSurface(
+    const std::string name,
+    std::vector<double>& q,
+    mesh& m,
+    mpi_wrapper& pool,
+    const std::vector<std::string>& boundaries,
+    const std::map<std::string, surface_quantity>& quantities,
+    const bool merged = true,
+    const bool binary = false
+);
+
+
+
+/*
+    Time series with the geometry written once
+    Each rank writes its points, mixed tri/quad topology and rank in a raw
+    binary geometry file at start(), then only the cell fields of each
+    snapshot. Rank 0 describes the series in an xdmf temporal collection,
+    name.xmf, kept complete so it is always readable.
+
+    write() may run on the output thread, without MPI. A snapshot is only
+    listed in name.xmf once every rank has written its piece: the solver
+    thread posts a non-blocking reduction of the written counts at every
+    step with publish() and appends the entries as they complete, a
+    few steps after the snapshot, and finish() lists the last ones.
+*/
+class time_series_writer {
+public:
+    std::string name;
+    mesh* m = nullptr;
+    int rank = 0;
+    int world_size = 1;
+    bool float64 = false;
+
+    // Points, cells and topology integers of each rank, on rank 0
+    std::vector<uint64_t> piecesPoints;
+    std::vector<uint64_t> piecesCells;
+    std::vector<uint64_t> piecesTopology;
+
+    std::ofstream xmf;
+    std::streamoff xmf_end = 0;     // position of the closing tags
 
+    // Snapshots written by this rank, in order
+    std::mutex mutex;
+    std::vector<std::string> writtenNames;
+    std::vector<double> writtenTimes;
+
+    // Minimum written count over the ranks, one reduction per posted snapshot
+    class count_reduction {
+    public:
+        uint64_t local;
+        uint64_t min;
+        MPI_Request request;
+    };
+    std::deque<count_reduction> reductions;
+    uint64_t published = 0;         // snapshots listed in name.xmf
+
+    void start(
+        const std::string name,
+        mesh& m,
+        mpi_wrapper& pool,
+        const bool float64 = false
+    );
+
+    void write(
+        std::vector<double>& q,
+        const std::string time_name,
+        const double time
+    );
+
+    // Collective, solver thread only, post a count reduction and list the completed ones
+    void publish();
+
+    // Collective, after the last write() returned, list every snapshot
+    void finish();
+
+private:
+    void append(const uint64_t count);
+    std::string piece_name(const int r) const;
+    std::string snapshot_grid(const std::string time_name, const double time) const;
+};
+
+
+
+/*
+    Background output of time series
+    Solution snapshots are copied to one of two staging buffers and passed
+    to the output function by a dedicated thread, including the
+    post::extra_scalars and post::extra_vectors evaluation. When both
+    buffers are still waiting to be written, write() blocks until one is
+    free. The output function must not call MPI.
+*/
+class async_writer {
+public:
+    std::function<void(std::vector<double>&, const std::string, const double)> output;
+
+    std::array<std::vector<double>, 2> staging;
+    std::array<std::string, 2> times;
+    std::array<double, 2> stamps;
+    std::array<bool, 2> full = {false, false};
+    uint next = 0;              // next buffer to fill
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stop = false;
+    std::exception_ptr error;   // rethrown on the solver thread
+
+    uint stalls = 0;            // writes that waited for a free buffer
+    double stall_seconds = 0.;
+
+    void start(
+        std::function<void(std::vector<double>&, const std::string, const double)> output
+    );
+
+    void write(
+        const std::vector<double>& q,
+        const std::string time_name,
+        const double time
+    );
+
+    void finish();
+
+    ~async_writer();
+
+private:
+    void run();
+};
+
+}
@@ -0,0 +1,57 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Spatial search header
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#pragma once
+
+#include <fvhyper/mesh.h>
+#include <vector>
+
+
+namespace fvhyper {
+
+
+/*
+    Point location in the owned cells of a mesh
+    The cells bounding boxes are sorted in a uniform grid of bins, about
+    cells_per_bin cells each, so a query only tests the cells of one bin
+*/
+class cell_locator {
+public:
+    double xmin, ymin;
+    double dx, dy;
+    uint nx = 0;
+    uint ny = 0;
+
+    std::vector<uint> binsStart;    // CSR offsets of each bin in binsCells
+    std::vector<uint> binsCells;    // cells overlapping each bin
+
+    mesh* m = nullptr;
+
+    void build(mesh& m, const double cells_per_bin = 2.);
+
+    // Cell containing (x, y), -1 if none on this rank
+    int locate(const double x, const double y) const;
+
+    void locate(
+        std::vector<int>& cells,
+        const std::vector<double>& x,
+        const std::vector<double>& y
+    ) const;
+
+    bool cell_contains(const uint i, const double x, const double y) const;
+};
+
+
+}
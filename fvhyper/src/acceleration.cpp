@@ -0,0 +1,161 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Convergence acceleration sources
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#include <fvhyper/acceleration.h>
+#include <mpi.h>
+#include <math.h>
+#include <algorithm>
+
+
+
+namespace fvhyper {
+
+
+
+void anderson_accelerator::init(const uint depth_in, const double safeguard_in, const uint size) {
+    depth = depth_in;
+    safeguard = safeguard_in;
+    x.resize(size);
+    f.resize(size);
+    f_old.resize(size);
+    g_old.resize(size);
+    dF.assign(depth, std::vector<double>(size));
+    dG.assign(depth, std::vector<double>(size));
+    n_stored = 0;
+    newest = 0;
+    f_norm_old = -1.;
+    resets = 0;
+}
+
+
+
+void anderson_accelerator::begin(const std::vector<double>& q) {
+    for (uint i=0; i<q.size(); ++i) {
+        x[i] = q[i];
+    }
+}
+
+
+
+void anderson_accelerator::extrapolate(std::vector<double>& q, mesh& m) {
+    const uint n = q.size();
+
+    auto owned = [&](const uint i) {
+        const uint c = i / vars;
+        return (c < m.nRealCells) && (!m.cellsIsGhost[c]);
+    };
+
+    // Fixed point residual f = G(x) - x
+    for (uint i=0; i<n; ++i) {
+        f[i] = q[i] - x[i];
+    }
+
+    // Push the newest differences into the circular history
+    if (f_norm_old >= 0.) {
+        newest = (n_stored == 0) ? 0 : (newest + 1) % depth;
+        for (uint i=0; i<n; ++i) {
+            dF[newest][i] = f[i] - f_old[i];
+            dG[newest][i] = q[i] - g_old[i];
+        }
+        n_stored = std::min(n_stored + 1, depth);
+    }
+
+    // |f|^2, dF^T f and dF^T dF, reduced in a single collective call
+    const uint nm = n_stored;
+    std::vector<double> sums(1 + nm + nm*nm, 0.);
+    for (uint i=0; i<n; ++i) {
+        if (!owned(i)) continue;
+        sums[0] += f[i]*f[i];
+        for (uint a=0; a<nm; ++a) {
+            sums[1 + a] += dF[a][i]*f[i];
+            for (uint b=a; b<nm; ++b) {
+                sums[1 + nm + a*nm + b] += dF[a][i]*dF[b][i];
+            }
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &sums[0], sums.size(), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+    const double f_norm = sqrt(sums[0]);
+
+    // Store f and G(x) for the next differences
+    for (uint i=0; i<n; ++i) {
+        f_old[i] = f[i];
+        g_old[i] = q[i];
+    }
+
+    // Safeguard, restart from the plain iterate if the residual grows
+    if ((f_norm_old >= 0.) && (f_norm > safeguard * f_norm_old)) {
+        n_stored = 0;
+        resets += 1;
+        f_norm_old = f_norm;
+        return;
+    }
+    f_norm_old = f_norm;
+    if (nm == 0) return;
+
+    // Normal equations (dF^T dF + reg) gamma = dF^T f
+    std::vector<double> A(nm*nm);
+    std::vector<double> gamma(nm);
+    double diag_max = 0.;
+    for (uint a=0; a<nm; ++a) {
+        for (uint b=a; b<nm; ++b) {
+            A[a*nm + b] = sums[1 + nm + a*nm + b];
+            A[b*nm + a] = A[a*nm + b];
+        }
+        gamma[a] = sums[1 + a];
+        diag_max = std::max(diag_max, A[a*nm + a]);
+    }
+    for (uint a=0; a<nm; ++a) {
+        A[a*nm + a] += regularization * diag_max;
+    }
+
+    // Gaussian elimination with partial pivoting
+    for (uint c=0; c<nm; ++c) {
+        uint piv = c;
+        for (uint r=c+1; r<nm; ++r) {
+            if (fabs(A[r*nm + c]) > fabs(A[piv*nm + c])) piv = r;
+        }
+        if (fabs(A[piv*nm + c]) < 1e-300) {
+            n_stored = 0;
+            return;
+        }
+        if (piv != c) {
+            for (uint k=0; k<nm; ++k) std::swap(A[c*nm + k], A[piv*nm + k]);
+            std::swap(gamma[c], gamma[piv]);
+        }
+        for (uint r=c+1; r<nm; ++r) {
+            const double fac = A[r*nm + c] / A[c*nm + c];
+            for (uint k=c; k<nm; ++k) A[r*nm + k] -= fac * A[c*nm + k];
+            gamma[r] -= fac * gamma[c];
+        }
+    }
+    for (uint c=nm; c>0; --c) {
+        const uint r = c-1;
+        for (uint k=r+1; k<nm; ++k) gamma[r] -= A[r*nm + k] * gamma[k];
+        gamma[r] /= A[r*nm + r];
+    }
+
+    // q = G(x) - dG gamma on owned cells
+    for (uint i=0; i<n; ++i) {
+        if (!owned(i)) continue;
+        for (uint a=0; a<nm; ++a) {
+            q[i] -= dG[a][i] * gamma[a];
+        }
+    }
+}
+
+
+
+}
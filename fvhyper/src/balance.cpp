@@ -0,0 +1,144 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Partition balance source
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#include <fvhyper/balance.h>
+#include <fvhyper/explicit.h>
+#include <fvhyper/timers.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+
+
+namespace fvhyper {
+
+
+namespace balance {
+
+    const char* stat_names[n_stats] = {
+        "owned cells",
+        "ghost cells",
+        "boundary cells",
+        "edges",
+        "boundary edges",
+        "neighbors",
+        "halo send KB",
+        "halo recv KB"
+    };
+
+    void report::measure(const mesh& m) {
+        uint ghosts = 0;
+        for (uint i=0; i<m.nRealCells; ++i) ghosts += m.cellsIsGhost[i];
+        uint64_t sent = 0, received = 0;
+        for (const auto& comm : m.comms) {
+            sent += comm.snd_indices.size()*vars*sizeof(double);
+            received += comm.rec_indices.size()*vars*sizeof(double);
+        }
+        stats[owned_cells] = m.nRealCells - ghosts;
+        stats[ghost_cells] = ghosts;
+        stats[boundary_cells] = m.cellsAreas.size() - m.nRealCells;
+        stats[edges] = m.edgesLengths.size();
+        stats[boundary_edges] = m.boundaryEdges.size();
+        stats[neighbors] = m.comms.size();
+        stats[halo_send_bytes] = sent;
+        stats[halo_recv_bytes] = received;
+    }
+
+
+    // Values of every rank on rank 0, by rank then value
+    static std::vector<double> gather(const double* values, const uint n, mpi_wrapper& pool) {
+        std::vector<double> all((pool.rank == 0) ? n*pool.size : 0);
+        MPI_Gather(values, n, MPI_DOUBLE, all.data(), n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        return all;
+    }
+
+    // One row of min, avg, max, max/avg and the ranks with the largest values
+    static void print_row(
+        const std::string name,
+        const std::vector<double>& all,
+        const uint k,
+        const uint n,
+        const double scale,
+        const int precision,
+        const uint worst,
+        const uint ranks
+    ) {
+        std::vector<double> v(ranks);
+        for (uint r=0; r<ranks; ++r) v[r] = all[n*r + k]*scale;
+        const double avg = std::accumulate(v.begin(), v.end(), 0.)/ranks;
+        const double max = *std::max_element(v.begin(), v.end());
+
+        std::vector<uint> order(ranks);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](uint a, uint b) {return v[a] > v[b];});
+        std::ostringstream worstRanks;
+        for (uint i=0; i<std::min(worst, ranks); ++i) {
+            worstRanks << (i > 0 ? ", " : "") << order[i];
+        }
+
+        std::cout << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(precision);
+        std::cout << std::setw(12) << *std::min_element(v.begin(), v.end());
+        std::cout << std::setw(12) << avg << std::setw(12) << max;
+        std::cout << std::setprecision(3) << std::setw(10) << ((avg > 0.) ? max/avg : 1.);
+        std::cout << "  " << worstRanks.str() << std::defaultfloat << "\n";
+    }
+
+    static void print_header(const std::string name) {
+        std::cout << std::left << std::setw(18) << name << std::right;
+        std::cout << std::setw(12) << "Min" << std::setw(12) << "Avg" << std::setw(12) << "Max";
+        std::cout << std::setw(10) << "Max/Avg" << "  Largest ranks\n";
+    }
+
+    void report::print_partition(mpi_wrapper& pool, const uint worst) const {
+        const std::vector<double> all = gather(stats, n_stats, pool);
+        if (pool.rank != 0) return;
+
+        print_header("Partition");
+        for (uint k=0; k<n_stats; ++k) {
+            const bool bytes = (k == halo_send_bytes) | (k == halo_recv_bytes);
+            print_row(stat_names[k], all, k, n_stats, bytes ? 1./1024 : 1., bytes ? 2 : 1, worst, pool.size);
+        }
+        std::cout << std::flush;
+    }
+
+    void report::start() {
+        begin = std::chrono::steady_clock::now();
+    }
+
+    void report::print_waits(const uint steps, mpi_wrapper& pool, const uint worst) const {
+        // Blocked in receives and barriers, the rest is computing and posting sends
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        const double wait = timers::totals[timers::mpi_recv].seconds + timers::totals[timers::mpi_barrier].seconds;
+        const double local[3] = {
+            1e3*(elapsed - wait)/std::max(steps, 1u),
+            1e3*wait/std::max(steps, 1u),
+            100.*wait/std::max(elapsed, 1e-300)
+        };
+        const std::vector<double> all = gather(local, 3, pool);
+        if (pool.rank != 0) return;
+
+        std::cout << "Exchange waits over the first " << steps << " steps\n";
+        print_header("Per step");
+        print_row("compute ms", all, 0, 3, 1., 3, worst, pool.size);
+        print_row("wait ms", all, 1, 3, 1., 3, worst, pool.size);
+        print_row("wait %", all, 2, 3, 1., 1, worst, pool.size);
+        std::cout << std::flush;
+    }
+}
+
+
+
+}
@@ -0,0 +1,250 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Checkpoint and restart source
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#include <fvhyper/checkpoint.h>
+#include <algorithm>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+
+namespace fvhyper {
+
+
+static const char checkpoint_magic[4] = {'F', 'V', 'H', 'C'};
+
+/*
+    Header : magic, version, vars, number of original cells, step, time,
+    save_time, time_step, R0[vars] and R[vars], then vars doubles per
+    original cell index
+*/
+static MPI_Offset checkpoint_header_size(const uint nvars) {
+    return 4 + 2*sizeof(uint32_t) + 2*sizeof(uint64_t) + 2*sizeof(double)
+        + sizeof(uint64_t) + 2*nvars*sizeof(double);
+}
+
+
+// Owned cells sorted by original index, as required by the file view
+static std::vector<uint> owned_cells_by_original(mesh& m, std::vector<int>& originals) {
+    std::vector<std::pair<int, uint>> sorted;
+    sorted.reserve(m.nRealCells);
+    for (auto& keyval : m.currentToOriginalCells) {
+        const uint i = keyval.first;
+        if ((i < m.nRealCells) && !m.cellsIsGhost[i]) sorted.emplace_back(keyval.second, i);
+    }
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<uint> cells(sorted.size());
+    originals.resize(sorted.size());
+    for (uint k=0; k<sorted.size(); ++k) {
+        originals[k] = sorted[k].first;
+        cells[k] = sorted[k].second;
+    }
+    return cells;
+}
+
+
+// Open a view of the cell blocks at their original indices
+static void set_cells_view(
+    MPI_File fh,
+    const MPI_Offset start,
+    const std::vector<int>& originals,
+    MPI_Datatype& cell,
+    MPI_Datatype& view
+) {
+    MPI_Type_contiguous(vars, MPI_DOUBLE, &cell);
+    MPI_Type_commit(&cell);
+    MPI_Type_create_indexed_block(originals.size(), 1, originals.data(), cell, &view);
+    MPI_Type_commit(&view);
+    MPI_File_set_view(fh, start, cell, view, "native", MPI_INFO_NULL);
+}
+
+
+void write_checkpoint(
+    const std::string filename,
+    std::vector<double>& q,
+    mesh& m,
+    mpi_wrapper& pool,
+    const checkpoint_state& state
+) {
+    std::vector<int> originals;
+    const std::vector<uint> cells = owned_cells_by_original(m, originals);
+
+    uint64_t nLocal = originals.empty() ? 0 : originals.back() + 1;
+    uint64_t nCells;
+    MPI_Allreduce(&nLocal, &nCells, 1, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+
+    const std::string tmpname = filename + ".tmp";
+    MPI_File fh;
+    if (MPI_File_open(MPI_COMM_WORLD, tmpname.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        throw std::invalid_argument("could not open checkpoint file " + tmpname);
+    }
+    MPI_File_set_size(fh, 0);
+
+    if (pool.rank == 0) {
+        std::vector<char> header;
+        auto put = [&](const void* v, const size_t bytes) {
+            header.insert(header.end(), (const char*) v, (const char*) v + bytes);
+        };
+        const uint32_t version = 1;
+        const uint32_t nvars = vars;
+        const uint64_t step = state.step;
+        const uint64_t time_step = state.time_step;
+        put(checkpoint_magic, 4);
+        put(&version, sizeof(version));
+        put(&nvars, sizeof(nvars));
+        put(&nCells, sizeof(nCells));
+        put(&step, sizeof(step));
+        put(&state.time, sizeof(double));
+        put(&state.save_time, sizeof(double));
+        put(&time_step, sizeof(time_step));
+        for (uint k=0; k<vars; ++k) {
+            const double r0 = (k < state.R0.size()) ? state.R0[k] : 1.;
+            put(&r0, sizeof(double));
+        }
+        for (uint k=0; k<vars; ++k) {
+            const double r = (k < state.R.size()) ? state.R[k] : 1.;
+            put(&r, sizeof(double));
+        }
+        MPI_File_write_at(fh, 0, header.data(), header.size(), MPI_CHAR, MPI_STATUS_IGNORE);
+    }
+
+    // Pack the owned cells in original order and write them all at once
+    std::vector<double> buffer(vars*cells.size());
+    for (uint k=0; k<cells.size(); ++k) {
+        std::memcpy(&buffer[vars*k], &q[vars*cells[k]], vars*sizeof(double));
+    }
+    MPI_Datatype cell, view;
+    set_cells_view(fh, checkpoint_header_size(vars), originals, cell, view);
+    MPI_File_write_all(fh, buffer.data(), cells.size(), cell, MPI_STATUS_IGNORE);
+    MPI_Type_free(&view);
+    MPI_Type_free(&cell);
+    MPI_File_close(&fh);
+
+    // Every rank throws if the rename failed, rather than waiting on rank 0
+    int renamed = 0;
+    if (pool.rank == 0) {
+        renamed = std::rename(tmpname.c_str(), filename.c_str()) == 0;
+    }
+    MPI_Bcast(&renamed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!renamed) {
+        throw std::invalid_argument("could not rename checkpoint file " + tmpname);
+    }
+}
+
+
+void read_checkpoint(
+    const std::string filename,
+    std::vector<double>& q,
+    mesh& m,
+    mpi_wrapper& pool,
+    checkpoint_state& state
+) {
+    MPI_File fh;
+    if (MPI_File_open(MPI_COMM_WORLD, filename.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        throw std::invalid_argument("could not open checkpoint file " + filename);
+    }
+
+    // Every rank reads the small header
+    std::vector<char> header(checkpoint_header_size(vars));
+    MPI_Status status;
+    int count = 0;
+    MPI_File_read_at(fh, 0, header.data(), header.size(), MPI_CHAR, &status);
+    MPI_Get_count(&status, MPI_CHAR, &count);
+    MPI_Offset fileSize;
+    MPI_File_get_size(fh, &fileSize);
+
+    uint offset = 0;
+    auto get = [&](void* v, const size_t bytes) {
+        std::memcpy(v, &header[offset], bytes);
+        offset += bytes;
+    };
+    char magic[4] = {0, 0, 0, 0};
+    uint32_t version = 0, nvars = 0;
+    uint64_t nCells = 0, step = 0, time_step = 0;
+    if (count == (int) header.size()) {
+        get(magic, 4);
+        get(&version, sizeof(version));
+        get(&nvars, sizeof(nvars));
+        get(&nCells, sizeof(nCells));
+        get(&step, sizeof(step));
+        get(&state.time, sizeof(double));
+        get(&state.save_time, sizeof(double));
+        get(&time_step, sizeof(time_step));
+    }
+    if ((count != (int) header.size()) || (std::memcmp(magic, checkpoint_magic, 4) != 0) || (version != 1)) {
+        MPI_File_close(&fh);
+        throw std::invalid_argument("invalid checkpoint file " + filename);
+    }
+    if ((nvars != vars) | (fileSize < checkpoint_header_size(vars) + (MPI_Offset) (nCells*vars*sizeof(double)))) {
+        MPI_File_close(&fh);
+        throw std::invalid_argument("checkpoint " + filename + " does not match the variables");
+    }
+    state.step = step;
+    state.time_step = time_step;
+    state.R0.resize(vars);
+    state.R.resize(vars);
+    get(state.R0.data(), vars*sizeof(double));
+    get(state.R.data(), vars*sizeof(double));
+
+    std::vector<int> originals;
+    const std::vector<uint> cells = owned_cells_by_original(m, originals);
+    int outside = (!originals.empty()) && ((uint64_t) originals.back() >= nCells);
+    MPI_Allreduce(MPI_IN_PLACE, &outside, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    if (outside) {
+        MPI_File_close(&fh);
+        throw std::invalid_argument("checkpoint " + filename + " does not match the mesh");
+    }
+
+    std::vector<double> buffer(vars*cells.size());
+    MPI_Datatype cell, view;
+    set_cells_view(fh, checkpoint_header_size(vars), originals, cell, view);
+    MPI_File_read_all(fh, buffer.data(), cells.size(), cell, MPI_STATUS_IGNORE);
+    MPI_Type_free(&view);
+    MPI_Type_free(&cell);
+    MPI_File_close(&fh);
+
+    if (q.size() < vars*m.cellsAreas.size()) {
+        q.resize(vars*m.cellsAreas.size());
+    }
+    for (uint k=0; k<cells.size(); ++k) {
+        std::memcpy(&q[vars*cells[k]], &buffer[vars*k], vars*sizeof(double));
+    }
+}
+
+
+
+static volatile std::sig_atomic_t sigterm_flag = 0;
+
+static void on_sigterm(int) {
+    sigterm_flag = 1;
+}
+
+void catch_sigterm() {
+    std::signal(SIGTERM, on_sigterm);
+}
+
+bool sigterm_received(mpi_wrapper& pool) {
+    int local = sigterm_flag;
+    int global = 0;
+    MPI_Allreduce(&local, &global, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    return global != 0;
+}
+
+
+
+}
@@ -0,0 +1,144 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Hardware counters source
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#include <fvhyper/counters.h>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+namespace fvhyper {
+
+
+namespace counters {
+
+    const char* event_names[n_events] = {
+        "cycles",
+        "instructions",
+        "llc_misses",
+        "branch_misses"
+    };
+
+    counter_group group;
+
+#ifdef __linux__
+
+    // Group read layout, with PERF_FORMAT_GROUP | TOTAL_TIME_ENABLED | TOTAL_TIME_RUNNING
+    struct group_read {
+        uint64_t nr;
+        uint64_t time_enabled;
+        uint64_t time_running;
+        uint64_t values[n_events];
+    };
+
+    static int open_event(const uint64_t config, const int leader) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.disabled = (leader == -1);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+    }
+
+    void read(uint64_t values[n_events]) {
+        group_read r;
+        if (::read(group.leader, &r, sizeof(r)) <= 0) {
+            for (uint e=0; e<n_events; ++e) values[e] = 0;
+            return;
+        }
+        for (uint e=0; e<n_events; ++e) {
+            values[e] = (group.slots[e] >= 0) ? r.values[group.slots[e]] : 0;
+        }
+    }
+
+    bool start() {
+        if (enabled()) stop();
+        const uint64_t configs[n_events] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES
+        };
+        group.n = 0;
+        group.error = "";
+        int first_errno = 0;
+        for (uint e=0; e<n_events; ++e) {
+            group.fds[e] = open_event(configs[e], group.leader);
+            group.slots[e] = -1;
+            if (group.fds[e] < 0) {
+                if (group.error == "") {
+                    first_errno = errno;
+                    group.error = std::string(event_names[e]) + ": " + std::strerror(errno);
+                }
+                continue;
+            }
+            if (group.leader < 0) group.leader = group.fds[e];
+            group.slots[e] = group.n++;
+        }
+        if (!enabled()) {
+            if ((first_errno == EACCES) | (first_errno == EPERM)) {
+                group.error += ", see /proc/sys/kernel/perf_event_paranoid";
+            }
+            return false;
+        }
+        ioctl(group.leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(group.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return true;
+    }
+
+    bool stop() {
+        if (!enabled()) return false;
+        group_read r;
+        const bool multiplexed = (::read(group.leader, &r, sizeof(r)) > 0) && (r.time_running < r.time_enabled);
+        ioctl(group.leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        for (uint e=0; e<n_events; ++e) {
+            if (group.fds[e] >= 0) close(group.fds[e]);
+            group.fds[e] = -1;
+            group.slots[e] = -1;
+        }
+        group.leader = -1;
+        group.n = 0;
+        return multiplexed;
+    }
+
+#else
+
+    void read(uint64_t values[n_events]) {
+        for (uint e=0; e<n_events; ++e) values[e] = 0;
+    }
+
+    bool start() {
+        group.error = "perf_event_open is only available on Linux";
+        return false;
+    }
+
+    bool stop() {return false;}
+
+#endif
+}
+
+
+
+}
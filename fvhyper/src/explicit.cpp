@@ -15,8 +15,18 @@
 */
 #include <fvhyper/explicit.h>
 #include <fvhyper/post.h>
+#include <fvhyper/implicit.h>
+#include <fvhyper/acceleration.h>
+#include <fvhyper/monitor.h>
+#include <fvhyper/checkpoint.h>
+#include <fvhyper/timers.h>
+#include <fvhyper/memory.h>
+#include <fvhyper/balance.h>
 #include <array>
 #include <chrono>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
 
 
 
@@ -33,35 +43,77 @@ void smooth_residuals(
     std::vector<double>& qt_,
     std::vector<double>& smoother_qt,
     std::vector<double>& smoother,
-    mesh& m
+    mesh& m,
+    mpi_wrapper& pool,
+    const solverOptions& opt
 ) {
     /*
         Smooth the residuals in r implicitly using jacobi iteration
+        With opt.smooth_exchange, ghost cells are exchanged before each
+        sweep, so the result does not depend on the number of ranks
     */
-    const uint iters = 2;
-    const double epsilon = 0.6;
+    timers::scoped_timer timer(timers::smooth_residuals);
+    double epsilon = opt.smooth_epsilon;
+    if (opt.smooth_cfl_ratio > 0.) {
+        epsilon = std::max(0., 0.25*(opt.smooth_cfl_ratio*opt.smooth_cfl_ratio - 1.));
+    }
 
-    for (int i=0; i<smoother_qt.size(); ++i) {
+    if (!opt.smooth_exchange) {
+        // Each rank smooths its cells alone, partition ghost cells included
+        for (uint i=0; i<smoother_qt.size(); ++i) {
+            smoother_qt[i] = qt_[i];
+        }
+        for (uint jacobi=0; jacobi<opt.smooth_iters; ++jacobi) {
+            for (uint i=0; i<smoother.size(); ++i) {
+                smoother[i] = 0.;
+            }
+            for (uint e=0; e<m.edgesCells.cols(); ++e) {
+                const uint i = m.edgesCells(e, 0);
+                const uint j = m.edgesCells(e, 1);
+                for (uint k=0; k<vars; ++k) {
+                    smoother[vars*i+k] -= qt_[vars*j+k] * epsilon;
+                    smoother[vars*j+k] -= qt_[vars*i+k] * epsilon;
+                }
+            }
+            for (uint i=0; i<m.nRealCells; ++i) {
+                const double ne = m.cellsIsTriangle[i] ? 3 : 4;
+                for (uint k=0; k<vars; ++k) {
+                    qt_[vars*i+k] = (smoother_qt[vars*i+k] - smoother[vars*i+k])/(1. + ne * epsilon);
+                }
+            }
+        }
+        return;
+    }
+
+    if (pool.size > 1) update_comms(qt_, m);
+    for (uint i=0; i<smoother_qt.size(); ++i) {
         smoother_qt[i] = qt_[i];
+        smoother[i] = 0.;
     }
-    for (int jacobi=0; jacobi<iters; ++jacobi) {
-        for (int i=0; i<smoother.size(); ++i) {
-            smoother[i] = 0.;
-        }
-        for (int e=0; e<m.edgesCells.cols(); ++e) {
-            const uint& i = m.edgesCells(e, 0);
-            const uint& j = m.edgesCells(e, 1);
+    for (uint jacobi=0; jacobi<opt.smooth_iters; ++jacobi) {
+        // Sum of the neighbour residuals, in a single pass over the edges
+        for (uint e=0; e<m.edgesCells.cols(); ++e) {
+            const uint i = m.edgesCells(e, 0);
+            const uint j = m.edgesCells(e, 1);
+            if (i == j) continue;
             for (uint k=0; k<vars; ++k) {
-                smoother[vars*i+k] -= qt_[vars*j+k] * epsilon;
-                smoother[vars*j+k] -= qt_[vars*i+k] * epsilon;
+                smoother[vars*i+k] += qt_[vars*j+k];
+                smoother[vars*j+k] += qt_[vars*i+k];
             }
         }
-        for (int i=0; i<m.nRealCells; ++i) {
-            const double ne = m.cellsIsTriangle[i] ? 3 : 4;
+        // Update the owned cells and reset the sums for the next sweep
+        for (uint i=0; i<m.cellsAreas.size(); ++i) {
+            if ((i < m.nRealCells) && (!m.cellsIsGhost[i])) {
+                const double ne = m.cellsIsTriangle[i] ? 3 : 4;
+                for (uint k=0; k<vars; ++k) {
+                    qt_[vars*i+k] = (smoother_qt[vars*i+k] + epsilon*smoother[vars*i+k])/(1. + ne * epsilon);
+                }
+            }
             for (uint k=0; k<vars; ++k) {
-                qt_[vars*i+k] = (smoother_qt[vars*i+k] - smoother[vars*i+k])/(1. + ne * epsilon);
+                smoother[vars*i+k] = 0.;
             }
         }
+        if (pool.size > 1) update_comms(qt_, m);
     }
 }
 
@@ -115,6 +167,7 @@ void calc_gradients(
     const std::vector<double>& q,
     mesh& m
 ) {
+    timers::scoped_timer timer(timers::calc_gradients);
     // reset gradients to be null
     for (uint i=0; i<gx.size(); ++i) {
         gx[i] = 0.;
@@ -180,6 +233,7 @@ void calc_limiters(
     const std::vector<double>& gy,
     mesh& m
 ) {
+    timers::scoped_timer timer(timers::calc_limiters);
     // Reset limiters to two
     for (uint i=0; i<limiters.size(); ++i) {
         limiters[i] = 1.;
@@ -258,90 +312,107 @@ void calc_limiters(
 }
 
 
-void calc_time_derivatives(
-    std::vector<double>& qt,
+void calc_edge_flux(
+    double* f,
+    const uint e,
     const std::vector<double>& q,
     const std::vector<double>& gx,
     const std::vector<double>& gy,
     const std::vector<double>& limiters,
     mesh& m
 ) {
-    // reset qt to be null
-    for (uint i=0; i<qt.size(); ++i) {
-        qt[i] = 0.;
-    }
-    // Compute time derivatives qt of q
-    for (uint e=0; e<m.edgesNodes.cols(); ++e) {
-        double n[2];
-        double di[2];
-        double dj[2];
-        double ci[2];
-        double cj[2];
+    double n[2];
+    double di[2];
+    double dj[2];
+    double ci[2];
+    double cj[2];
 
-        const uint i = m.edgesCells(e, 0);
-        const uint j = m.edgesCells(e, 1);
-        const double le = m.edgesLengths[e];
-        
-        n[0] = m.edgesNormalsX[e];
-        n[1] = m.edgesNormalsY[e];
+    const uint i = m.edgesCells(e, 0);
+    const uint j = m.edgesCells(e, 1);
 
-        const double cx = m.edgesCentersX[e];
-        const double cy = m.edgesCentersY[e];
+    n[0] = m.edgesNormalsX[e];
+    n[1] = m.edgesNormalsY[e];
 
-        ci[0] = m.cellsCentersX[i];
-        ci[1] = m.cellsCentersY[i];
+    const double cx = m.edgesCentersX[e];
+    const double cy = m.edgesCentersY[e];
 
-        cj[0] = m.cellsCentersX[j];
-        cj[1] = m.cellsCentersY[j];
+    ci[0] = m.cellsCentersX[i];
+    ci[1] = m.cellsCentersY[i];
 
-        di[0] = cx - ci[0];
-        di[1] = cy - ci[1];
+    cj[0] = m.cellsCentersX[j];
+    cj[1] = m.cellsCentersY[j];
 
-        dj[0] = cx - cj[0];
-        dj[1] = cy - cj[1];
+    di[0] = cx - ci[0];
+    di[1] = cy - ci[1];
 
-        // Compute edge center values
-        double qi[vars];
-        double qj[vars];
+    dj[0] = cx - cj[0];
+    dj[1] = cy - cj[1];
 
-        if (solver::linear_interpolate) {
-            for (uint k=0; k<vars; ++k) {
-                const uint ki = vars*i+k;
-                const uint kj = vars*j+k;
-                qi[k] = q[ki] + (gx[ki]*di[0] + gy[ki]*di[1])*limiters[ki];
-                qj[k] = q[kj] + (gx[kj]*dj[0] + gy[kj]*dj[1])*limiters[kj];
-            }
-        } else {
-            for (uint k=0; k<vars; ++k) {
-                qi[k] = q[vars*i+k];
-                qj[k] = q[vars*j+k];
-            }
-        }
+    // Compute edge center values
+    double qi[vars];
+    double qj[vars];
 
-        // Compute viscous fluxes
-        double gxv[vars];
-        double gyv[vars];
+    if (solver::linear_interpolate) {
+        for (uint k=0; k<vars; ++k) {
+            const uint ki = vars*i+k;
+            const uint kj = vars*j+k;
+            qi[k] = q[ki] + (gx[ki]*di[0] + gy[ki]*di[1])*limiters[ki];
+            qj[k] = q[kj] + (gx[kj]*dj[0] + gy[kj]*dj[1])*limiters[kj];
+        }
+    } else {
+        for (uint k=0; k<vars; ++k) {
+            qi[k] = q[vars*i+k];
+            qj[k] = q[vars*j+k];
+        }
+    }
 
-        if (solver::diffusive_gradients) {
-            gradient_for_diffusion(
-                gxv, gyv,
-                &gx[vars*i], &gy[vars*i],
-                &gx[vars*j], &gy[vars*j],
-                &q[vars*i], &q[vars*j],
-                ci, cj
-            );
-        } else {
-            for (uint k=0; k<vars; ++k) {
-                gxv[k] = 0.;
-                gyv[k] = 0.;
-            }
+    // Compute viscous fluxes
+    double gxv[vars];
+    double gyv[vars];
+
+    if (solver::diffusive_gradients) {
+        gradient_for_diffusion(
+            gxv, gyv,
+            &gx[vars*i], &gy[vars*i],
+            &gx[vars*j], &gy[vars*j],
+            &q[vars*i], &q[vars*j],
+            ci, cj
+        );
+    } else {
+        for (uint k=0; k<vars; ++k) {
+            gxv[k] = 0.;
+            gyv[k] = 0.;
         }
+    }
+
+    // Compute fluxes
+    calc_flux(
+        f, qi, qj, gxv, gyv, n
+    );
+}
+
+
+void calc_time_derivatives(
+    std::vector<double>& qt,
+    const std::vector<double>& q,
+    const std::vector<double>& gx,
+    const std::vector<double>& gy,
+    const std::vector<double>& limiters,
+    mesh& m
+) {
+    timers::scoped_timer timer(timers::calc_time_derivatives);
+    // reset qt to be null
+    for (uint i=0; i<qt.size(); ++i) {
+        qt[i] = 0.;
+    }
+    // Compute time derivatives qt of q
+    for (uint e=0; e<m.edgesNodes.cols(); ++e) {
+        const uint i = m.edgesCells(e, 0);
+        const uint j = m.edgesCells(e, 1);
+        const double le = m.edgesLengths[e];
 
-        // Compute fluxes
         double f[vars];
-        calc_flux(
-            f, qi, qj, gxv, gyv, n
-        );
+        calc_edge_flux(f, e, q, gx, gy, limiters, m);
 
         // Update qt
         for (uint k=0; k<vars; ++k) {
@@ -377,6 +448,30 @@ void update_cells(
     }
 }
 
+void update_cells(
+    std::vector<double>& q,
+    std::vector<double>& ql,
+    const std::vector<double>& qt,
+    const std::vector<double>& dt,
+    const double v,
+    const mesh& m,
+    std::vector<double>& R
+) {
+    for (uint i=0; i<m.nRealCells; ++i) {
+        for (uint j=0; j<vars; ++j) {
+            q[vars*i+j] = ql[vars*i+j] + qt[vars*i+j] * dt[vars*i+j] * v;
+        }
+        if (!m.cellsIsGhost[i]) {
+            for (uint j=0; j<vars; ++j) {
+                R[j] += qt[vars*i+j]*qt[vars*i+j] * m.cellsAreas[i];
+            }
+        }
+    }
+    for (uint i=vars*m.nRealCells; i<q.size(); ++i) {
+        q[i] = ql[i] + qt[i] * dt[i] * v;
+    }
+}
+
 void update_bounds(
     std::vector<double>& q,
     std::vector<double>& gx,
@@ -384,6 +479,7 @@ void update_bounds(
     std::vector<double>& limiters,
     mesh& m
 ) {
+    timers::scoped_timer timer(timers::update_bounds);
     // Update the ghost cells with boundary conditions
     for (uint b=0; b<m.boundaryEdges.size(); ++b) {
         const uint e = m.boundaryEdges[b];
@@ -421,10 +517,13 @@ void update_comms(
     std::vector<double>& q,
     mesh& m
 ) {
+    timers::scoped_timer timer(timers::update_comms);
 
     std::vector<MPI_Request> reqs(m.comms.size());
     uint k = 0;
     for (auto& comm : m.comms) {
+        const uint64_t bytes = comm.snd_q.size()*sizeof(double);
+        timers::add_bytes(timers::update_comms, bytes);
 
         uint iter = 0;
         for (const auto& i : comm.snd_indices) {
@@ -435,6 +534,7 @@ void update_comms(
         }
 
         // Send values
+        timers::scoped_timer send_timer(timers::mpi_send, comm.out_rank, bytes);
         MPI_Isend(
         /* data         = */ &comm.snd_q[0], 
         /* count        = */ comm.snd_q.size(), 
@@ -450,15 +550,18 @@ void update_comms(
     // Recieve values from all communicating cells
     for (auto& comm : m.comms) {
         // Recieve values
-        MPI_Recv(
-        /* data         = */ &comm.rec_q[0], 
-        /* count        = */ comm.rec_q.size(), 
-        /* datatype     = */ MPI_DOUBLE, 
-        /* source       = */ comm.out_rank, 
-        /* tag          = */ 0,
-        /* communicator = */ MPI_COMM_WORLD,
-        /* status       = */ MPI_STATUS_IGNORE
-        );
+        {
+            timers::scoped_timer wait_timer(timers::mpi_recv, comm.out_rank, comm.rec_q.size()*sizeof(double));
+            MPI_Recv(
+            /* data         = */ &comm.rec_q[0], 
+            /* count        = */ comm.rec_q.size(), 
+            /* datatype     = */ MPI_DOUBLE, 
+            /* source       = */ comm.out_rank, 
+            /* tag          = */ 0,
+            /* communicator = */ MPI_COMM_WORLD,
+            /* status       = */ MPI_STATUS_IGNORE
+            );
+        }
         uint iter = 0;
         for (const auto& i : comm.rec_indices) {
             for (uint j=0; j<vars; ++j) {
@@ -468,7 +571,10 @@ void update_comms(
         }
     }
 
-    MPI_Barrier( MPI_COMM_WORLD );
+    {
+        timers::scoped_timer barrier_timer(timers::mpi_barrier);
+        MPI_Barrier( MPI_COMM_WORLD );
+    }
 
     // Free requests
     for (uint i=0; i<reqs.size(); ++i) {
@@ -484,15 +590,11 @@ void calc_residuals(
     mesh& m,
     mpi_wrapper& pool
 ) {
+    timers::scoped_timer timer(timers::calc_residuals);
+    std::vector<double> sums(vars, 0.);
+    accumulate_residuals(sums, qt, m);
     for (uint i=0; i<vars; ++i) {
-        R[i] = 0.;
-    }
-    for (uint i=0; i<m.nRealCells; ++i) {
-        if (!m.cellsIsGhost[i]) {
-            for (uint j=0; j<vars; ++j) {
-                R[j] += qt[vars*i+j]*qt[vars*i+j] * m.cellsAreas[i];
-            }
-        }
+        R[i] = sums[i];
     }
 
     if (pool.rank != 0) {
@@ -507,15 +609,18 @@ void calc_residuals(
     } else {
         double R_other[vars];
         for (uint i=1; i<pool.size; ++i) {
-            MPI_Recv(
-            /* data         = */ R_other, 
-            /* count        = */ vars, 
-            /* datatype     = */ MPI_DOUBLE, 
-            /* source       = */ i, 
-            /* tag          = */ 0,
-            /* communicator = */ MPI_COMM_WORLD,
-            /* status       = */ MPI_STATUS_IGNORE
-            );
+            {
+                timers::scoped_timer wait_timer(timers::mpi_recv, i, vars*sizeof(double));
+                MPI_Recv(
+                /* data         = */ R_other,
+                /* count        = */ vars,
+                /* datatype     = */ MPI_DOUBLE,
+                /* source       = */ i,
+                /* tag          = */ 0,
+                /* communicator = */ MPI_COMM_WORLD,
+                /* status       = */ MPI_STATUS_IGNORE
+                );
+            }
             for (uint j=0; j<vars; ++j) {
                 R[j] += R_other[j];
             }
@@ -538,20 +643,67 @@ void calc_residuals(
             );
         }
     } else {
-        MPI_Recv(
-        /* data         = */ R, 
-        /* count        = */ vars, 
-        /* datatype     = */ MPI_DOUBLE, 
-        /* source       = */ 0, 
-        /* tag          = */ 0,
-        /* communicator = */ MPI_COMM_WORLD,
-        /* status       = */ MPI_STATUS_IGNORE
-        );
+        {
+            timers::scoped_timer wait_timer(timers::mpi_recv, 0, vars*sizeof(double));
+            MPI_Recv(
+            /* data         = */ R,
+            /* count        = */ vars,
+            /* datatype     = */ MPI_DOUBLE,
+            /* source       = */ 0,
+            /* tag          = */ 0,
+            /* communicator = */ MPI_COMM_WORLD,
+            /* status       = */ MPI_STATUS_IGNORE
+            );
+        }
     }
     
 }
 
 
+void accumulate_residuals(
+    std::vector<double>& R,
+    const std::vector<double>& qt,
+    const mesh& m
+) {
+    for (uint i=0; i<m.nRealCells; ++i) {
+        if (!m.cellsIsGhost[i]) {
+            for (uint j=0; j<vars; ++j) {
+                R[j] += qt[vars*i+j]*qt[vars*i+j] * m.cellsAreas[i];
+            }
+        }
+    }
+}
+
+
+void residual_reduction::clear() {
+    sums.assign(vars, 0.);
+}
+
+void residual_reduction::post(const uint step_, const double time_, const double seconds_) {
+    timers::scoped_timer timer(timers::calc_residuals);
+    posted = sums;
+    reduced.resize(vars);
+    MPI_Iallreduce(posted.data(), reduced.data(), vars, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD, &request);
+    step = step_;
+    time = time_;
+    seconds = seconds_;
+    pending = true;
+}
+
+bool residual_reduction::complete(double* R) {
+    if (!pending) return false;
+    {
+        timers::scoped_timer wait_timer(timers::mpi_recv, -1, vars*sizeof(double));
+        MPI_Wait(&request, MPI_STATUS_IGNORE);
+    }
+    for (uint i=0; i<vars; ++i) {
+        R[i] = sqrt(reduced[i]);
+    }
+    pending = false;
+    return true;
+}
+
+
 void min_dt(std::vector<double>& dt, mesh& m) {
     // Minimize dt
     double min_dt = dt[0];
@@ -578,15 +730,18 @@ void validate_dt(std::vector<double>& dt, mpi_wrapper& pool) {
     } else {
         double dti;
         for (uint i=1; i<pool.size; ++i) {
-            MPI_Recv(
-            /* data         = */ &dti, 
-            /* count        = */ 1, 
-            /* datatype     = */ MPI_DOUBLE, 
-            /* source       = */ i, 
-            /* tag          = */ 0,
-            /* communicator = */ MPI_COMM_WORLD,
-            /* status       = */ MPI_STATUS_IGNORE
-            );
+            {
+                timers::scoped_timer wait_timer(timers::mpi_recv, i, sizeof(double));
+                MPI_Recv(
+                /* data         = */ &dti,
+                /* count        = */ 1,
+                /* datatype     = */ MPI_DOUBLE,
+                /* source       = */ i,
+                /* tag          = */ 0,
+                /* communicator = */ MPI_COMM_WORLD,
+                /* status       = */ MPI_STATUS_IGNORE
+                );
+            }
         }
         dt[0] = std::min(dt[0], dti);
     }
@@ -603,15 +758,18 @@ void validate_dt(std::vector<double>& dt, mpi_wrapper& pool) {
             );
         }
     } else {
-        MPI_Recv(
-        /* data         = */ &dt[0], 
-        /* count        = */ 1, 
-        /* datatype     = */ MPI_DOUBLE, 
-        /* source       = */ 0, 
-        /* tag          = */ 0,
-        /* communicator = */ MPI_COMM_WORLD,
-        /* status       = */ MPI_STATUS_IGNORE
-        );
+        {
+            timers::scoped_timer wait_timer(timers::mpi_recv, 0, sizeof(double));
+            MPI_Recv(
+            /* data         = */ &dt[0],
+            /* count        = */ 1,
+            /* datatype     = */ MPI_DOUBLE,
+            /* source       = */ 0,
+            /* tag          = */ 0,
+            /* communicator = */ MPI_COMM_WORLD,
+            /* status       = */ MPI_STATUS_IGNORE
+            );
+        }
 
         // Dispatch this dt to all other dts
         for (uint i=1; i<dt.size(); ++i) {
@@ -622,8 +780,7 @@ void validate_dt(std::vector<double>& dt, mpi_wrapper& pool) {
 
 
 
-void complete_calc_qt(
-    std::vector<double>& qt,
+void calc_reconstruction(
     std::vector<double>& q,
     std::vector<double>& gx,
     std::vector<double>& gy,
@@ -647,6 +804,21 @@ void complete_calc_qt(
         calc_limiters(limiters, qmin, qmax, q, gx, gy, m);
         if (pool.size > 1) update_comms(limiters, m);
     }
+}
+
+
+void complete_calc_qt(
+    std::vector<double>& qt,
+    std::vector<double>& q,
+    std::vector<double>& gx,
+    std::vector<double>& gy,
+    std::vector<double>& qmin,
+    std::vector<double>& qmax,
+    std::vector<double>& limiters,
+    mesh& m,
+    mpi_wrapper& pool
+) {
+    calc_reconstruction(q, gx, gy, qmin, qmax, limiters, m, pool);
 
     // Compute time derivative
     calc_time_derivatives(qt, q, gx, gy, limiters, m);
@@ -654,6 +826,91 @@ void complete_calc_qt(
 
 
 
+residual_operator::residual_operator(mesh& m_in, mpi_wrapper& pool_in) {
+    m = &m_in;
+    pool = &pool_in;
+
+    const uint n = vars*m->cellsAreas.size();
+    qt.resize(n);
+    gx.resize(n);
+    gy.resize(n);
+    qmin.resize(n);
+    qmax.resize(n);
+    limiters.resize(n);
+    qp.resize(n);
+}
+
+
+std::vector<double>& residual_operator::operator()(std::vector<double>& q) {
+    complete_calc_qt(qt, q, gx, gy, qmin, qmax, limiters, *m, *pool);
+    return qt;
+}
+
+
+void residual_operator::reconstruct(std::vector<double>& q) {
+    calc_reconstruction(q, gx, gy, qmin, qmax, limiters, *m, *pool);
+}
+
+
+std::vector<double>& residual_operator::perturbed(
+    const std::vector<double>& q,
+    const std::vector<double>& v,
+    const double eps
+) {
+    for (uint i=0; i<qp.size(); ++i) {
+        qp[i] = q[i] + eps*v[i];
+    }
+    // Gradients and limiters are those of the last full evaluation
+    update_bounds(qp, gx, gy, limiters, *m);
+    if (pool->size > 1) update_comms(qp, *m);
+    calc_time_derivatives(qt, qp, gx, gy, limiters, *m);
+    return qt;
+}
+
+
+void residual_operator::jacobian_vector(
+    std::vector<double>& jv,
+    const std::vector<double>& r,
+    const std::vector<double>& q,
+    const std::vector<double>& v,
+    const double eps
+) {
+    perturbed(q, v, eps);
+    for (uint i=0; i<jv.size(); ++i) {
+        jv[i] = (qt[i] - r[i]) / eps;
+    }
+}
+
+
+void residual_operator::partial(
+    std::vector<double>& qt_out,
+    const std::vector<double>& q,
+    const std::vector<uint>& cells
+) {
+    mesh& msh = *m;
+    for (const auto& c : cells) {
+        for (uint k=0; k<vars; ++k) {
+            qt_out[vars*c+k] = 0.;
+        }
+        if ((c >= msh.nRealCells) || msh.cellsIsGhost[c]) continue;
+
+        for (uint p=msh.cellsEdgesStart[c]; p<msh.cellsEdgesStart[c+1]; ++p) {
+            const uint e = msh.cellsEdges[p];
+            double f[vars];
+            calc_edge_flux(f, e, q, gx, gy, limiters, msh);
+
+            // Flux leaves the first cell of the edge
+            const double sign = (msh.edgesCells(e, 0) == c) ? -1. : 1.;
+            const double factor = sign * msh.edgesLengths[e] / msh.cellsAreas[c];
+            for (uint k=0; k<vars; ++k) {
+                qt_out[vars*c+k] += f[k] * factor;
+            }
+        }
+    }
+}
+
+
+
 void run(
     const std::string name,
     std::vector<double>& q,
@@ -663,16 +920,22 @@ void run(
 ) {
 
     q.resize(vars*m.cellsAreas.size());
-    generate_initial_solution(q, m);
+    checkpoint_state restart;
+    if (opt.restart_file != "") {
+        read_checkpoint(opt.restart_file, q, m, pool, restart);
+        if (pool.size > 1) update_comms(q, m);
+    } else {
+        generate_initial_solution(q, m);
+    }
 
     std::vector<double> qk(q.size());
 
-    std::vector<double> qt(q.size());
-    std::vector<double> gx(q.size());
-    std::vector<double> gy(q.size());
-    std::vector<double> limiters(q.size());
-    std::vector<double> qmin(q.size());
-    std::vector<double> qmax(q.size());
+    residual_operator residual(m, pool);
+    std::vector<double>& qt = residual.qt;
+    std::vector<double>& gx = residual.gx;
+    std::vector<double>& gy = residual.gy;
+    std::vector<double>& limiters = residual.limiters;
+
     std::vector<double> dt(q.size());
     std::vector<double> q_smooth0(q.size());
     std::vector<double> q_smooth1(q.size());
@@ -688,12 +951,119 @@ void run(
 
     bool running = true;
 
-    uint step = 0;
-    double time = 0;
+    uint step = restart.step;
+    double time = restart.time;
 
     double R0[vars];
     double R[vars];
     for (uint i=0; i<vars; ++i) {R[i] = 1.0;}
+    if (opt.restart_file != "") {
+        for (uint i=0; i<vars; ++i) {
+            R0[i] = restart.R0[i];
+            R[i] = restart.R[i];
+        }
+    }
+
+
+    double save_time = (opt.restart_file != "") ? restart.save_time : opt.time_series_interval;
+    uint time_step = restart.time_step;
+    if (opt.xdmf_time_series & opt.collective_output) {
+        throw std::invalid_argument("xdmf_time_series and collective_output can not be combined");
+    }
+    // Ranks decide to write from their own time with local time steps
+    if (opt.save_time_series & opt.collective_output & !solver::global_dt) {
+        throw std::invalid_argument("collective_output requires solver::global_dt");
+    }
+    if (opt.save_time_series & opt.vtk_point_data & !solver::global_dt) {
+        throw std::invalid_argument("vtk_point_data requires solver::global_dt");
+    }
+    post::compression compression;
+    compression.level = opt.vtk_compression;
+    compression.tolerances = opt.vtk_tolerances;
+    time_series_writer series;
+    if (opt.save_time_series & opt.xdmf_time_series) {
+        series.start(name, m, pool, opt.vtk_float64);
+    }
+    auto output_snapshot = [&](std::vector<double>& qs, const std::string time_name, const double t) {
+        if (opt.xdmf_time_series) {
+            series.write(qs, time_name, t);
+        } else if (opt.collective_output) {
+            writeVtkCollective(name, qs, m, pool, time_name, opt.vtk_float64);
+        } else {
+            post::output_stats stats;
+            if (opt.native_time_series) {
+                std::filesystem::create_directories("times");
+                const std::string piece = (pool.size > 1) ? name + "_" + std::to_string(pool.rank) : name;
+                stats = write_snapshot("times/" + piece + "_" + time_name + ".fvq", qs, m, opt.vtk_float64, compression);
+            } else {
+                stats = writeVtk(name, qs, m, pool.rank, pool.size, time_name, opt.vtk_float64, compression, opt.vtk_point_data);
+            }
+            if ((opt.verbose)&(pool.rank == 0)&(opt.native_time_series | (compression.level > 0))) {
+                // One string per snapshot, this may run on the output thread
+                std::ostringstream line;
+                line << "Snapshot " << time_name << " : ratio " << ((double) stats.raw_bytes)/stats.file_bytes;
+                line << ", " << stats.raw_bytes/stats.seconds/1e6 << " MB/s\n";
+                std::cout << line.str() << std::flush;
+            }
+        }
+    };
+    async_writer output;
+    // Collective output and point data call MPI and stay on the solver thread
+    const bool async_output = opt.async_output & !opt.collective_output & !opt.vtk_point_data;
+    if (opt.save_time_series & async_output) {
+        output.start(output_snapshot);
+    }
+
+    // Build the implicit lines and sweep ordering
+    if ((opt.line_implicit | opt.lusgs) & (opt.spectral_radius == nullptr)) {
+        throw std::invalid_argument("implicit smoothers require a spectral_radius callback");
+    }
+    line_smoother lines;
+    if (opt.line_implicit) lines.make_lines(m, opt.line_walls, opt.line_min_aspect);
+    lusgs_solver lusgs;
+    if (opt.lusgs) lusgs.make_ordering(m);
+
+    // Anderson acceleration of the steady iterations
+    anderson_accelerator anderson;
+    if (opt.anderson_depth > 0) anderson.init(opt.anderson_depth, opt.anderson_safeguard, q.size());
+    bool converged = false;
+
+    // Memory footprint once everything is allocated
+    memory::footprint footprint;
+    if (opt.print_memory | (opt.memory_file != "")) {
+        footprint.add_mesh(m);
+        footprint.add("solver.q", memory::heap(q));
+        footprint.add("solver.qk", memory::heap(qk));
+        footprint.add("solver.qt", memory::heap(qt));
+        footprint.add("solver.gx", memory::heap(gx));
+        footprint.add("solver.gy", memory::heap(gy));
+        footprint.add("solver.qmin", memory::heap(residual.qmin));
+        footprint.add("solver.qmax", memory::heap(residual.qmax));
+        footprint.add("solver.limiters", memory::heap(limiters));
+        footprint.add("solver.qp", memory::heap(residual.qp));
+        footprint.add("solver.dt", memory::heap(dt));
+        footprint.add("solver.q_smooth0", memory::heap(q_smooth0));
+        footprint.add("solver.q_smooth1", memory::heap(q_smooth1));
+        footprint.add("solver.line_implicit",
+            memory::heap(lines.linesStart) + memory::heap(lines.linesCells) + memory::heap(lines.linesEdges)
+            + memory::heap(lines.diag) + memory::heap(lines.faceCoefs) + memory::heap(lines.cp) + memory::heap(lines.dp));
+        footprint.add("solver.lusgs",
+            memory::heap(lusgs.order) + memory::heap(lusgs.dq) + memory::heap(lusgs.diag)
+            + memory::heap(lusgs.faceCoefs) + memory::heap(lusgs.faceFluxes));
+        footprint.add("solver.anderson",
+            memory::heap(anderson.x) + memory::heap(anderson.f) + memory::heap(anderson.f_old)
+            + memory::heap(anderson.g_old) + memory::heap(anderson.dF) + memory::heap(anderson.dG));
+        footprint.setup_peak_rss = memory::peak_rss();
+        if (opt.print_memory & opt.verbose) footprint.print(pool);
+    }
+
+    balance::report balance;
+    const bool print_balance = opt.print_balance & opt.verbose;
+    bool balance_printed = false;
+    if (print_balance) {
+        balance.measure(m);
+        balance.print_partition(pool);
+    }
 
     if ((opt.verbose)&(pool.rank == 0)) {
         std::cout << "Step, Time, RealTime, ";
@@ -704,14 +1074,61 @@ void run(
         std::cout << std::endl;
     }
 
-
-    double save_time = opt.time_series_interval;
-    uint time_step = 0;
+    timers::reset();
+    if (opt.trace_file != "") timers::start_trace(opt.trace_events);
+    if (print_balance) balance.start();
+    if (opt.hardware_counters) {
+        // Counters on every rank or none, so the reduced counts are comparable
+        int started = counters::start();
+        MPI_Allreduce(MPI_IN_PLACE, &started, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        if (!started) {
+            counters::stop();
+            if (opt.verbose & (pool.rank == 0)) {
+                std::cout << "Hardware counters unavailable";
+                if (counters::group.error != "") std::cout << " (" << counters::group.error << ")";
+                std::cout << ", only timing the phases" << std::endl;
+            }
+        }
+    }
+    for (auto mon : opt.monitors) {
+        mon->restarted = opt.restart_file != "";
+        mon->init(m, pool);
+    }
+    if (opt.checkpoint_on_sigterm) catch_sigterm();
+    bool monitors_converged = false;
 
     // Init the ghost cells with boundary conditions
     update_bounds(q, gx, gy, limiters, m);
 
     std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    auto elapsed = [&]() {
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        int microseconds = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+        return ((double) microseconds) / 1e6;
+    };
+
+    // Residual lines are buffered by cout and flushed every log_flush_interval seconds
+    std::chrono::steady_clock::time_point last_flush = begin;
+    auto flush_log = [&](const bool force) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (force | (std::chrono::duration<double>(now - last_flush).count() >= opt.log_flush_interval)) {
+            std::cout << std::flush;
+            last_flush = now;
+        }
+    };
+    auto log_residuals = [&](const uint s, const double t, const double seconds, const double* Rs) {
+        std::cout << s << ", " << t << ", " << seconds << ", ";
+        for (uint i=0; i<vars; ++i) {
+            std::cout << Rs[i];
+            if (i < vars-1) {std::cout << ", ";}
+        }
+        std::cout << "\n";
+        flush_log(false);
+    };
+
+    const bool check_tolerance = opt.tolerance > 1.01e-16;
+    residual_reduction norms;
+    norms.clear();
     while (running) {
 
         // Convergence check
@@ -720,99 +1137,237 @@ void run(
             for (uint i=0; i<vars; ++i) {Rmax = std::max(R[i], Rmax);}
         } else {Rmax = 1.0;}
 
-        if ((step >= opt.max_step)|(time >= opt.max_time)|(Rmax < opt.tolerance)) {
+        if ((step >= opt.max_step)|(time >= opt.max_time)|(Rmax < opt.tolerance)|monitors_converged) {
+            converged = (Rmax < opt.tolerance);
             running = false;
             break;
         }
+        timers::scoped_timer step_timer(timers::step);
+        const bool norm_step = (step == 0) | (step % opt.print_interval == 0) | check_tolerance;
 
         // Compute time step and update comms with dt
-        calc_dt(dt, q, m);
-        if (pool.size > 1) update_comms(dt, m);
-        if (solver::global_dt) {
-            min_dt(dt, m);
-            if (pool.size > 1) validate_dt(dt, pool);
+        {
+            timers::scoped_timer timer(timers::calc_dt);
+            calc_dt(dt, q, m);
+            if (pool.size > 1) update_comms(dt, m);
+            if (solver::global_dt) {
+                min_dt(dt, m);
+                if (pool.size > 1) validate_dt(dt, pool);
+            }
         }
         
-        // Runge kutta iterations
-
-        // Store q in qk
-        for (uint i=0; i<q.size(); ++i) qk[i] = q[i];
+        const bool accelerate = (opt.anderson_depth > 0) & (step >= opt.anderson_start);
+        if (accelerate) anderson.begin(q);
+
+        if (opt.lusgs) {
+            // LU-SGS implicit iteration
+            residual(q);
+            {
+                timers::scoped_timer timer(timers::implicit_smoothing);
+                lusgs.iterate(q, qt, dt, m, pool, opt);
+            }
+            if (norm_step) {
+                timers::scoped_timer timer(timers::calc_residuals);
+                norms.clear();
+                accumulate_residuals(norms.sums, qt, m);
+            }
+            update_bounds(q, gx, gy, limiters, m);
+            if (pool.size > 1) update_comms(q, m);
+        } else {
+            // Runge kutta iterations
+
+            // Store q in qk
+            for (uint i=0; i<q.size(); ++i) qk[i] = q[i];
+
+            for (uint k=0; k<alpha.size(); ++k) {
+                const double a = alpha[k];
+                residual(qk);
+                if (solver::smooth_residuals) smooth_residuals(qt, q_smooth0, q_smooth1, m, pool, opt);
+                if (opt.line_implicit) {
+                    timers::scoped_timer timer(timers::implicit_smoothing);
+                    lines.smooth(qt, qk, dt, a, m, opt.spectral_radius, opt.viscous_spectral_radius);
+                }
+                // The last stage also sums the residuals of the step
+                if (norm_step & (k == alpha.size() - 1)) {
+                    norms.clear();
+                    update_cells(qk, q, qt, dt, a, m, norms.sums);
+                } else {
+                    update_cells(qk, q, qt, dt, a);
+                }
+                update_bounds(qk, gx, gy, limiters, m);
+                if (pool.size > 1) update_comms(qk, m);
+            }
+            // Get back qk values into q
+            for (uint i=0; i<q.size(); ++i) q[i] = qk[i];
+        }
 
-        for (const double& a : alpha) {
-            complete_calc_qt(qt, qk, gx, gy, qmin, qmax, limiters, m, pool);
-            if (solver::smooth_residuals) smooth_residuals(qt, q_smooth0, q_smooth1, m);
-            update_cells(qk, q, qt, dt, a);
-            update_bounds(qk, gx, gy, limiters, m);
-            if (pool.size > 1) update_comms(qk, m);
+        // Extrapolate over the last iterates
+        if (accelerate) {
+            anderson.extrapolate(q, m);
+            update_bounds(q, gx, gy, limiters, m);
+            if (pool.size > 1) update_comms(q, m);
         }
-        // Get back qk values into q
-        for (uint i=0; i<q.size(); ++i) q[i] = qk[i];
 
-        // Compute residuals
+        // Norms of the previous step, then start the reduction of this one
+        if (norms.complete(R)) {
+            for (uint i=0; i<vars; ++i) {R[i] = R[i]/R0[i];}
+            if ((norms.step % opt.print_interval == 0) & (opt.verbose) & (pool.rank == 0)) {
+                log_residuals(norms.step, norms.time, norms.seconds, R);
+            }
+        }
         if (step == 0) {
-            calc_residuals(R0, qt, m, pool);
+            // Blocking, the later norms are relative to this one
+            norms.post(step, time, elapsed());
+            norms.complete(R0);
             for (uint i=0; i<vars; ++i) {R[i] = R0[i];}
 
             if ((pool.rank == 0) & (opt.verbose)) {
-                std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-                int microseconds = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
-                double seconds = ((double) microseconds) / 1e6;
-
-                std::cout << step << ", " << time << ", " << seconds << ", ";
+                std::cout << step << ", " << time << ", " << elapsed() << ", ";
                 for (uint i=0; i<vars; ++i) {
                     std::cout << "1.0";
                     if (i < vars-1) {std::cout << ", ";}
                 }
-                std::cout << std::endl;
-            }
-        } else if ((step % opt.print_interval == 0)|(opt.tolerance > 1.01e-16)) {
-            
-            calc_residuals(R, qt, m, pool);
-            for (uint i=0; i<vars; ++i) {R[i] = R[i]/R0[i];}
-
-            if ((step % opt.print_interval == 0) & (opt.verbose) & (pool.rank == 0)) {
-                std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-                int microseconds = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
-                double seconds = ((double) microseconds) / 1e6;
-
-                std::cout << step << ", " << time << ", " << seconds << ", ";
-                for (uint i=0; i<vars; ++i) {
-                    std::cout << R[i];
-                    if (i < vars-1) {std::cout << ", ";}
-                }
-                std::cout << std::endl;
+                std::cout << "\n";
+                flush_log(false);
             }
+        } else if (norm_step) {
+            norms.post(step, time, elapsed());
         }
 
         // If save time series, save time series
         if (opt.save_time_series) {
             if (time > save_time) {
+                timers::scoped_timer timer(timers::output);
                 // Save file to ./times/ folder
                 std::string timename = std::to_string(time_step);
-                writeVtk(name, q, m, pool.rank, pool.size, timename);
+                if (async_output) {
+                    output.write(q, timename, time);
+                } else {
+                    output_snapshot(q, timename, time);
+                }
                 save_time += opt.time_series_interval;
                 time_step += 1;
             }
+            // Every step, time may differ between ranks with local time steps
+            if (opt.xdmf_time_series) series.publish();
+        }
+
+        // Gradients and limiters are those of the last stage input, monitors
+        //  sample q with its own reconstruction
+        bool reconstructed = false;
+        for (auto mon : opt.monitors) {
+            if (step % mon->interval == 0) {
+                timers::scoped_timer timer(timers::monitors);
+                if (!reconstructed) {
+                    residual.reconstruct(q);
+                    reconstructed = true;
+                }
+                mon->update(step, time, q, residual, m, pool);
+                monitors_converged |= mon->converged();
+            }
         }
 
         // Edit step and time
         step += 1;
         time += dt[0];
+
+        if (print_balance & (step - restart.step == opt.balance_steps)) {
+            balance.print_waits(opt.balance_steps, pool);
+            balance_printed = true;
+        }
+
+        // Checkpoint the state at the start of the next step, the signal is
+        //  only looked for every sigterm_interval steps to avoid a global sync
+        const bool terminate = opt.checkpoint_on_sigterm
+            && (step % std::max(opt.sigterm_interval, 1u) == 0)
+            && sigterm_received(pool);
+        if (((opt.checkpoint_interval > 0) && (step % opt.checkpoint_interval == 0)) | terminate) {
+            checkpoint_state state;
+            state.step = step;
+            state.time = time;
+            state.R0.assign(R0, R0 + vars);
+            state.R.assign(R, R + vars);
+            state.save_time = save_time;
+            state.time_step = time_step;
+            timers::scoped_timer timer(timers::checkpoint);
+            write_checkpoint(name + ".chk", q, m, pool, state);
+        }
+        if (terminate) {
+            if ((opt.verbose)&(pool.rank == 0)) {
+                std::cout << "Terminated, checkpoint written at step " << step << std::endl;
+            }
+            break;
+        }
+    }
+
+    // Norms of the last step
+    if (norms.complete(R)) {
+        double Rmax = 0.;
+        for (uint i=0; i<vars; ++i) {
+            R[i] = R[i]/R0[i];
+            Rmax = std::max(R[i], Rmax);
+        }
+        converged |= check_tolerance & (Rmax < opt.tolerance);
+        if ((norms.step % opt.print_interval == 0) & (opt.verbose) & (pool.rank == 0)) {
+            log_residuals(norms.step, norms.time, norms.seconds, R);
+        }
     }
 
     if ((opt.verbose)&(pool.rank == 0)) {
         // End prints
-        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-        int microseconds = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
-        double seconds = ((double) microseconds) / 1e6;
+        log_residuals(step, time, elapsed(), R);
+        flush_log(true);
 
-        std::cout << step << ", " << time << ", " << seconds << ", ";
-        for (uint i=0; i<vars; ++i) {
-            std::cout << R[i];
-            if (i < vars-1) {std::cout << ", ";}
+        if (converged) {
+            std::cout << "Converged to tolerance " << opt.tolerance << " in " << step << " steps";
+            if (opt.anderson_depth > 0) {
+                std::cout << " (Anderson depth " << opt.anderson_depth << ", " << anderson.resets << " resets)";
+            }
+            std::cout << std::endl;
+        }
+        if (monitors_converged) {
+            std::cout << "Monitors converged in " << step << " steps" << std::endl;
+        }
+    }
+
+    for (auto mon : opt.monitors) mon->finish();
+
+    if (print_balance & !balance_printed) balance.print_waits(step - restart.step, pool);
+
+    // Wait for the pending time series files
+    output.finish();
+    if (opt.save_time_series & opt.xdmf_time_series) series.finish();
+    if ((opt.verbose)&(pool.rank == 0)&(output.stalls > 0)) {
+        std::cout << "Output waited " << output.stall_seconds << " s for the writer thread (";
+        std::cout << output.stalls << " snapshots)" << std::endl;
+    }
+
+    // Peak resident set size over the whole run, avg and max of the ranks
+    footprint.solve_peak_rss = memory::peak_rss();
+    if (opt.print_memory) {
+        double rss_sum = footprint.solve_peak_rss;
+        double rss_max = footprint.solve_peak_rss;
+        MPI_Allreduce(MPI_IN_PLACE, &rss_sum, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        MPI_Allreduce(MPI_IN_PLACE, &rss_max, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        if ((opt.verbose)&(pool.rank == 0)) {
+            std::cout << "Peak rss, solve: " << rss_sum/pool.size/1e6 << " MB avg, ";
+            std::cout << rss_max/1e6 << " MB max" << std::endl;
+        }
+    }
+
+    if (opt.print_timers | (opt.timers_file != "")) {
+        timers::report(pool, opt.print_timers & opt.verbose, opt.timers_file);
+    }
+    if (counters::enabled()) {
+        timers::report_counters(pool, m.edgesLengths.size(), opt.verbose, opt.counters_file);
+        int multiplexed = counters::stop();
+        MPI_Allreduce(MPI_IN_PLACE, &multiplexed, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+        if (opt.verbose & (pool.rank == 0) & (multiplexed != 0)) {
+            std::cout << "Hardware counters were multiplexed, counts are partial" << std::endl;
         }
-        std::cout << std::endl;
     }
+    if (opt.trace_file != "") timers::write_trace(opt.trace_file, pool);
+    if (opt.memory_file != "") footprint.write(opt.memory_file, pool);
 
 }
 
@@ -0,0 +1,387 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Implicit smoothers sources
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#include <fvhyper/implicit.h>
+#include <algorithm>
+
+
+
+namespace fvhyper {
+
+
+
+double face_spectral_radius(
+    const uint e,
+    const std::vector<double>& q,
+    mesh& m,
+    double (*spectral_radius)(const double*, const double*),
+    double (*viscous_spectral_radius)(const double*)
+) {
+    const uint i = m.edgesCells(e, 0);
+    const uint j = m.edgesCells(e, 1);
+
+    double n[2];
+    n[0] = m.edgesNormalsX[e];
+    n[1] = m.edgesNormalsY[e];
+
+    // Convective part, largest of both sides
+    double lambda = std::max(
+        spectral_radius(&q[vars*i], n),
+        spectral_radius(&q[vars*j], n)
+    );
+
+    // Viscous part, nu/d from both sides
+    if (viscous_spectral_radius != nullptr) {
+        const double dx = m.cellsCentersX[i] - m.cellsCentersX[j];
+        const double dy = m.cellsCentersY[i] - m.cellsCentersY[j];
+        const double d = sqrt(dx*dx + dy*dy);
+        if (d > 0.) {
+            lambda += (
+                viscous_spectral_radius(&q[vars*i]) +
+                viscous_spectral_radius(&q[vars*j])
+            ) / d;
+        }
+    }
+    return lambda;
+}
+
+
+
+void line_smoother::make_lines(
+    mesh& m,
+    const std::vector<std::string>& walls,
+    const double min_aspect
+) {
+    const uint n_cells = m.cellsAreas.size();
+
+    // Coupling weight of each edge, l/d between both cell centers
+    std::vector<double> weights(m.edgesLengths.size());
+    std::vector<double> wmax(n_cells, 0.);
+    std::vector<double> wmin(n_cells, 1e300);
+    for (uint e=0; e<m.edgesLengths.size(); ++e) {
+        const uint i = m.edgesCells(e, 0);
+        const uint j = m.edgesCells(e, 1);
+        const double dx = m.cellsCentersX[i] - m.cellsCentersX[j];
+        const double dy = m.cellsCentersY[i] - m.cellsCentersY[j];
+        const double d = sqrt(dx*dx + dy*dy);
+        weights[e] = (d > 0.) ? m.edgesLengths[e] / d : 0.;
+
+        wmax[i] = std::max(wmax[i], weights[e]);
+        wmin[i] = std::min(wmin[i], weights[e]);
+        if (j != i) {
+            wmax[j] = std::max(wmax[j], weights[e]);
+            wmin[j] = std::min(wmin[j], weights[e]);
+        }
+    }
+
+    // Only owned cells can be part of a line
+    std::vector<bool> in_line(n_cells, true);
+    for (uint i=0; i<m.nRealCells; ++i) {
+        in_line[i] = m.cellsIsGhost[i];
+    }
+
+    linesStart.clear();
+    linesCells.clear();
+    linesEdges.clear();
+    linesStart.push_back(0);
+
+    // March from each wall cell along the strongest couplings
+    for (uint b=0; b<m.boundaryEdges.size(); ++b) {
+        if (walls.size() > 0) {
+            const std::string& bname = m.physicalNames[m.boundaryEdgesIntTag[b]];
+            if (std::find(walls.begin(), walls.end(), bname) == walls.end()) continue;
+        }
+        uint c = m.edgesCells(m.boundaryEdges[b], 0);
+        if (in_line[c]) continue;
+
+        in_line[c] = true;
+        linesCells.push_back(c);
+        linesEdges.push_back(m.boundaryEdges[b]);
+
+        // Stop once the cells are no longer stretched
+        while (wmax[c] >= min_aspect * wmin[c]) {
+            int next = -1;
+            uint next_edge = 0;
+            double wnext = 0.;
+            for (uint k=m.cellsEdgesStart[c]; k<m.cellsEdgesStart[c+1]; ++k) {
+                const uint e = m.cellsEdges[k];
+                const uint nb = (m.edgesCells(e, 0) == c) ? m.edgesCells(e, 1) : m.edgesCells(e, 0);
+                if ((nb == c) || in_line[nb]) continue;
+                if (weights[e] > wnext) {
+                    wnext = weights[e];
+                    next = nb;
+                    next_edge = e;
+                }
+            }
+            // The link must also be one of the strongest of the neighbour
+            if ((next < 0) || (wnext < 0.5*wmax[next])) break;
+
+            c = next;
+            in_line[c] = true;
+            linesCells.push_back(c);
+            linesEdges.push_back(next_edge);
+        }
+        linesStart.push_back(linesCells.size());
+    }
+
+    // Remaining cells are single cell lines
+    for (uint i=0; i<m.nRealCells; ++i) {
+        if (!in_line[i]) {
+            linesCells.push_back(i);
+            linesEdges.push_back(0);
+            linesStart.push_back(linesCells.size());
+        }
+    }
+
+    diag.resize(n_cells);
+    faceCoefs.resize(m.edgesLengths.size());
+    cp.resize(linesCells.size());
+    dp.resize(vars*linesCells.size());
+}
+
+
+
+void line_smoother::smooth(
+    std::vector<double>& qt,
+    const std::vector<double>& q,
+    const std::vector<double>& dt,
+    const double alpha,
+    mesh& m,
+    double (*spectral_radius)(const double*, const double*),
+    double (*viscous_spectral_radius)(const double*)
+) {
+    /*
+        Replace qt by dq/(alpha*dt), with dq solution of
+            (A/(alpha*dt) + 1/2 sum(lambda*l)) dq_i - 1/2 sum_line(lambda*l dq_j) = A qt_i
+        Neighbours outside the line of cell i are treated explicitly
+    */
+    for (uint i=0; i<m.cellsAreas.size(); ++i) {
+        diag[i] = m.cellsAreas[i] / (alpha * dt[vars*i]);
+    }
+    for (uint e=0; e<m.edgesLengths.size(); ++e) {
+        const uint i = m.edgesCells(e, 0);
+        const uint j = m.edgesCells(e, 1);
+        const double coef = 0.5 * m.edgesLengths[e] * face_spectral_radius(
+            e, q, m, spectral_radius, viscous_spectral_radius
+        );
+        faceCoefs[e] = coef;
+        diag[i] += coef;
+        if (j != i) diag[j] += coef;
+    }
+
+    // Thomas algorithm along each line
+    for (uint l=0; l<linesStart.size()-1; ++l) {
+        const uint start = linesStart[l];
+        const uint end = linesStart[l+1];
+
+        // Forward elimination
+        for (uint p=start; p<end; ++p) {
+            const uint c = linesCells[p];
+            double denom = diag[c];
+            double lower = 0.;
+            if (p > start) {
+                lower = -faceCoefs[linesEdges[p]];
+                denom -= lower * cp[p-1];
+            }
+            cp[p] = (p+1 < end) ? -faceCoefs[linesEdges[p+1]] / denom : 0.;
+            for (uint k=0; k<vars; ++k) {
+                double rhs = m.cellsAreas[c] * qt[vars*c+k];
+                if (p > start) rhs -= lower * dp[vars*(p-1)+k];
+                dp[vars*p+k] = rhs / denom;
+            }
+        }
+
+        // Back substitution
+        for (uint p=end-1; p>start; --p) {
+            for (uint k=0; k<vars; ++k) {
+                dp[vars*(p-1)+k] -= cp[p-1] * dp[vars*p+k];
+            }
+        }
+
+        for (uint p=start; p<end; ++p) {
+            const uint c = linesCells[p];
+            for (uint k=0; k<vars; ++k) {
+                qt[vars*c+k] = dp[vars*p+k] / (alpha * dt[vars*c+k]);
+            }
+        }
+    }
+}
+
+
+
+uint line_smoother::size() const {
+    return linesStart.size() - 1;
+}
+
+
+
+void lusgs_solver::make_ordering(mesh& m) {
+    // Breadth first ordering of the owned cells over the edge graph
+    std::vector<bool> visited(m.cellsAreas.size(), true);
+    for (uint i=0; i<m.nRealCells; ++i) {
+        visited[i] = m.cellsIsGhost[i];
+    }
+
+    order.clear();
+    order.reserve(m.nRealCells);
+    for (uint s=0; s<m.nRealCells; ++s) {
+        if (visited[s]) continue;
+        visited[s] = true;
+        order.push_back(s);
+        for (uint p=order.size()-1; p<order.size(); ++p) {
+            const uint c = order[p];
+            for (uint k=m.cellsEdgesStart[c]; k<m.cellsEdgesStart[c+1]; ++k) {
+                const uint e = m.cellsEdges[k];
+                const uint nb = (m.edgesCells(e, 0) == c) ? m.edgesCells(e, 1) : m.edgesCells(e, 0);
+                if (!visited[nb]) {
+                    visited[nb] = true;
+                    order.push_back(nb);
+                }
+            }
+        }
+    }
+
+    dq.resize(vars*m.cellsAreas.size());
+    diag.resize(m.cellsAreas.size());
+    faceCoefs.resize(m.edgesLengths.size());
+    faceFluxes.resize(2*vars*m.edgesLengths.size());
+}
+
+
+
+void lusgs_solver::sweep_cell(
+    const uint i,
+    const std::vector<double>& q,
+    const std::vector<double>& qt,
+    mesh& m
+) {
+    double rhs[vars];
+    for (uint k=0; k<vars; ++k) {
+        rhs[k] = m.cellsAreas[i] * qt[vars*i+k];
+    }
+
+    double zeros[vars];
+    for (uint k=0; k<vars; ++k) zeros[k] = 0.;
+
+    for (uint p=m.cellsEdgesStart[i]; p<m.cellsEdgesStart[i+1]; ++p) {
+        const uint e = m.cellsEdges[p];
+        const bool first = (m.edgesCells(e, 0) == i);
+        const uint j = first ? m.edgesCells(e, 1) : m.edgesCells(e, 0);
+
+        // Boundary cells are explicit, dq = 0
+        if ((j == i) || (j >= m.nRealCells)) continue;
+
+        bool is_zero = true;
+        for (uint k=0; k<vars; ++k) {
+            if (dq[vars*j+k] != 0.) is_zero = false;
+        }
+        if (is_zero) continue;
+
+        double n[2];
+        n[0] = m.edgesNormalsX[e];
+        n[1] = m.edgesNormalsY[e];
+
+        double qj[vars];
+        for (uint k=0; k<vars; ++k) {
+            qj[k] = q[vars*j+k] + dq[vars*j+k];
+        }
+        double f[vars];
+        calc_flux(f, qj, qj, zeros, zeros, n);
+
+        // Normal points out of cell i if i is the first cell of the edge
+        const double* f0 = &faceFluxes[2*vars*e + (first ? vars : 0)];
+        const double sign = first ? 1. : -1.;
+        const double half_l = 0.5*m.edgesLengths[e];
+        for (uint k=0; k<vars; ++k) {
+            rhs[k] -= half_l*sign*(f[k] - f0[k]) - faceCoefs[e]*dq[vars*j+k];
+        }
+    }
+
+    for (uint k=0; k<vars; ++k) {
+        dq[vars*i+k] = rhs[k] / diag[i];
+    }
+}
+
+
+
+void lusgs_solver::iterate(
+    std::vector<double>& q,
+    std::vector<double>& qt,
+    const std::vector<double>& dt,
+    mesh& m,
+    mpi_wrapper& pool,
+    const solverOptions& opt
+) {
+    /*
+        Solve (A/dt + 1/2 sum(lambda*l)) dq_i + sum_j offdiag_ij(dq_j) = A qt_i
+        with symmetric Gauss-Seidel sweeps, then update q += dq
+        On exit, qt holds dq/dt, like the smoothed qt of the RK stages
+    */
+    for (uint i=0; i<m.cellsAreas.size(); ++i) {
+        diag[i] = m.cellsAreas[i] / dt[vars*i];
+    }
+    for (uint i=0; i<dq.size(); ++i) {
+        dq[i] = 0.;
+    }
+
+    double zeros[vars];
+    for (uint k=0; k<vars; ++k) zeros[k] = 0.;
+
+    for (uint e=0; e<m.edgesLengths.size(); ++e) {
+        const uint i = m.edgesCells(e, 0);
+        const uint j = m.edgesCells(e, 1);
+        const double coef = 0.5 * m.edgesLengths[e] * face_spectral_radius(
+            e, q, m, opt.spectral_radius, opt.viscous_spectral_radius
+        );
+        faceCoefs[e] = coef;
+        diag[i] += coef;
+        if (j != i) diag[j] += coef;
+
+        // Reference normal fluxes of both cells
+        if ((j != i) && (j < m.nRealCells)) {
+            double n[2];
+            n[0] = m.edgesNormalsX[e];
+            n[1] = m.edgesNormalsY[e];
+            calc_flux(&faceFluxes[2*vars*e], &q[vars*i], &q[vars*i], zeros, zeros, n);
+            calc_flux(&faceFluxes[2*vars*e + vars], &q[vars*j], &q[vars*j], zeros, zeros, n);
+        }
+    }
+
+    for (uint s=0; s<opt.lusgs_sweeps; ++s) {
+        // Forward sweep
+        for (uint p=0; p<order.size(); ++p) {
+            sweep_cell(order[p], q, qt, m);
+        }
+        if (pool.size > 1) update_comms(dq, m);
+
+        // Backward sweep
+        for (uint p=order.size(); p>0; --p) {
+            sweep_cell(order[p-1], q, qt, m);
+        }
+        if (pool.size > 1) update_comms(dq, m);
+    }
+
+    // Update owned cells
+    for (const auto& i : order) {
+        for (uint k=0; k<vars; ++k) {
+            q[vars*i+k] += dq[vars*i+k];
+            qt[vars*i+k] = dq[vars*i+k] / dt[vars*i+k];
+        }
+    }
+}
+
+
+
+}
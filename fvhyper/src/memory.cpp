@@ -0,0 +1,187 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Memory footprint sources
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#include <fvhyper/memory.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+
+
+namespace fvhyper {
+
+
+namespace memory {
+
+    uint64_t peak_rss() {
+        // ru_maxrss is in kilobytes on linux
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return ((uint64_t) usage.ru_maxrss)*1024;
+    }
+
+    void footprint::add(const std::string name, const uint64_t bytes) {
+        entries.push_back({name, bytes});
+    }
+
+    void footprint::add_mesh(const mesh& m) {
+        add("mesh.filename", heap(m.filename));
+        add("mesh.meshFormat", heap(m.meshFormat));
+        add("mesh.physicalNames", heap(m.physicalNames));
+        add("mesh.entityTagToPhysicalTag", heap(m.entityTagToPhysicalTag));
+        add("mesh.entitiesNumber", heap(m.entitiesNumber));
+        add("mesh.nodesX", heap(m.nodesX));
+        add("mesh.nodesY", heap(m.nodesY));
+        add("mesh.originalNodesRef", heap(m.originalNodesRef));
+        add("mesh.edgesNodes", m.edgesNodes.capacity()*sizeof(uint));
+        add("mesh.edgesCells", m.edgesCells.capacity()*sizeof(uint));
+        add("mesh.edgesLengths", heap(m.edgesLengths));
+        add("mesh.edgesNormalsX", heap(m.edgesNormalsX));
+        add("mesh.edgesNormalsY", heap(m.edgesNormalsY));
+        add("mesh.edgesCentersX", heap(m.edgesCentersX));
+        add("mesh.edgesCentersY", heap(m.edgesCentersY));
+        add("mesh.boundaryEdges", heap(m.boundaryEdges));
+        add("mesh.boundaryEdges0", heap(m.boundaryEdges0));
+        add("mesh.boundaryEdges1", heap(m.boundaryEdges1));
+        add("mesh.boundaryEdgesIntTag", heap(m.boundaryEdgesIntTag));
+        add("mesh.boundaryFuncs", heap(m.boundaryFuncs));
+        add("mesh.edgesRef", heap(m.edgesRef));
+        add("mesh.cellsNodes", m.cellsNodes.capacity()*sizeof(uint));
+        add("mesh.cellsIsTriangle", heap(m.cellsIsTriangle));
+        add("mesh.cellsAreas", heap(m.cellsAreas));
+        add("mesh.cellsCentersX", heap(m.cellsCentersX));
+        add("mesh.cellsCentersY", heap(m.cellsCentersY));
+        add("mesh.cellsIsGhost", heap(m.cellsIsGhost));
+        add("mesh.originalToCurrentCells", heap(m.originalToCurrentCells));
+        add("mesh.currentToOriginalCells", heap(m.currentToOriginalCells));
+        add("mesh.ghostCellsOriginalIndices", heap(m.ghostCellsOriginalIndices));
+        add("mesh.ghostCellsCurrentIndices", heap(m.ghostCellsCurrentIndices));
+        add("mesh.ghostCellsOwners", heap(m.ghostCellsOwners));
+        add("mesh.cellsEdgesStart", heap(m.cellsEdgesStart));
+        add("mesh.cellsEdges", heap(m.cellsEdges));
+        add("mesh.nodesCellsStart", heap(m.nodesCellsStart));
+        add("mesh.nodesCells", heap(m.nodesCells));
+        add("mesh.nodesCellsWeights", heap(m.nodesCellsWeights));
+
+        uint64_t comms = m.comms.capacity()*sizeof(mpi_comm_cells);
+        for (auto& comm : m.comms) {
+            comms += heap(comm.snd_indices) + heap(comm.rec_indices) + heap(comm.snd_q) + heap(comm.rec_q);
+        }
+        add("mesh.comms", comms);
+        uint64_t nodes_comms = m.nodesComms.capacity()*sizeof(mpi_comm_nodes);
+        for (auto& comm : m.nodesComms) {
+            nodes_comms += heap(comm.snd_nodes) + heap(comm.rec_nodes) + heap(comm.snd_q) + heap(comm.rec_q);
+        }
+        add("mesh.nodesComms", nodes_comms);
+    }
+
+    // Bytes of every entry and the two peaks, for all ranks on rank 0
+    static std::vector<double> gather(const footprint& f, mpi_wrapper& pool) {
+        const uint n = f.entries.size() + 2;
+        std::vector<double> local(n);
+        for (uint i=0; i<f.entries.size(); ++i) local[i] = f.entries[i].bytes;
+        local[n-2] = f.setup_peak_rss;
+        local[n-1] = f.solve_peak_rss;
+        std::vector<double> all((pool.rank == 0) ? n*pool.size : 0);
+        MPI_Gather(local.data(), n, MPI_DOUBLE, all.data(), n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        return all;
+    }
+
+    void footprint::print(mpi_wrapper& pool) const {
+        const auto all = gather(*this, pool);
+        if (pool.rank != 0) return;
+
+        const uint n = entries.size() + 2;
+        std::vector<double> avg(n, 0.);
+        std::vector<double> max(n, 0.);
+        for (uint r=0; r<pool.size; ++r) {
+            for (uint i=0; i<n; ++i) {
+                avg[i] += all[n*r + i]/pool.size;
+                max[i] = std::max(max[i], all[n*r + i]);
+            }
+        }
+
+        // Largest first, empty structures skipped
+        std::vector<uint> order(entries.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](const uint a, const uint b) {
+            return max[a] > max[b];
+        });
+        double accounted_avg = 0.;
+        for (uint i=0; i<entries.size(); ++i) accounted_avg += avg[i];
+
+        auto line = [&](const std::string name, const double a, const double m) {
+            std::cout << std::left << std::setw(32) << name << std::right << std::fixed;
+            std::cout << std::setprecision(3) << std::setw(14) << a/1e6 << std::setw(14) << m/1e6;
+            std::cout << std::setw(14) << a*pool.size/1e6 << std::defaultfloat << "\n";
+        };
+        std::cout << std::left << std::setw(32) << "Structure" << std::right;
+        std::cout << std::setw(14) << "Avg (MB)" << std::setw(14) << "Max (MB)";
+        std::cout << std::setw(14) << "Total (MB)" << "\n";
+        for (auto i : order) {
+            if (max[i] == 0.) continue;
+            line(entries[i].name, avg[i], max[i]);
+        }
+        double accounted_rank_max = 0.;
+        for (uint r=0; r<pool.size; ++r) {
+            double s = 0.;
+            for (uint i=0; i<entries.size(); ++i) s += all[n*r + i];
+            accounted_rank_max = std::max(accounted_rank_max, s);
+        }
+        line("accounted", accounted_avg, accounted_rank_max);
+        if (setup_peak_rss > 0) line("peak rss, setup", avg[n-2], max[n-2]);
+        if (solve_peak_rss > 0) line("peak rss, solve", avg[n-1], max[n-1]);
+        std::cout << std::flush;
+    }
+
+    void footprint::write(const std::string filename, mpi_wrapper& pool) const {
+        const auto all = gather(*this, pool);
+        if (pool.rank != 0) return;
+
+        std::ofstream out(filename);
+        if (!out) {
+            throw std::invalid_argument("could not open memory file " + filename);
+        }
+        const uint n = entries.size() + 2;
+        auto item = [&](const std::string name, const uint i, const bool last) {
+            double avg = 0.;
+            double max = 0.;
+            out << "    \"" << name << "\": {\"ranks\": [";
+            for (uint r=0; r<pool.size; ++r) {
+                out << ((r == 0) ? "" : ", ") << (uint64_t) all[n*r + i];
+                avg += all[n*r + i]/pool.size;
+                max = std::max(max, all[n*r + i]);
+            }
+            out << "], \"avg\": " << (uint64_t) avg << ", \"max\": " << (uint64_t) max << "}";
+            out << (last ? "\n" : ",\n");
+        };
+        // Bytes, per rank in rank order
+        out << "{\n  \"ranks\": " << pool.size << ",\n  \"structures\": {\n";
+        for (uint i=0; i<entries.size(); ++i) {
+            item(entries[i].name, i, i + 1 == entries.size());
+        }
+        out << "  },\n  \"peak_rss\": {\n";
+        item("setup", n-2, false);
+        item("solve", n-1, true);
+        out << "  }\n}\n";
+    }
+}
+
+
+
+}
@@ -17,7 +17,9 @@
 #include <fstream>
 #include <map>
 #include <algorithm>
+#include <limits>
 #include <stdexcept>
+#include <random>
 
 
 
@@ -670,6 +672,151 @@ void mesh::add_boundary_cells() {
 
 
 
+void mesh::compute_cells_edges() {
+    // Build the cell to edges connectivity in compressed row format
+    const uint n_cells = cellsAreas.size();
+    cellsEdgesStart.assign(n_cells + 1, 0);
+    for (uint e=0; e<edgesLengths.size(); ++e) {
+        const uint i = edgesCells(e, 0);
+        const uint j = edgesCells(e, 1);
+        cellsEdgesStart[i+1] += 1;
+        if (j != i) cellsEdgesStart[j+1] += 1;
+    }
+    for (uint i=0; i<n_cells; ++i) {
+        cellsEdgesStart[i+1] += cellsEdgesStart[i];
+    }
+    cellsEdges.resize(cellsEdgesStart[n_cells]);
+    std::vector<uint> fill(cellsEdgesStart.begin(), cellsEdgesStart.end() - 1);
+    for (uint e=0; e<edgesLengths.size(); ++e) {
+        const uint i = edgesCells(e, 0);
+        const uint j = edgesCells(e, 1);
+        cellsEdges[fill[i]++] = e;
+        if (j != i) cellsEdges[fill[j]++] = e;
+    }
+}
+
+
+
+void mesh::compute_nodes_cells() {
+    // Build the node to real cells connectivity in compressed row format
+    //  with inverse distance weights. Cells of each node are sorted by
+    //  original index, so a node shared by partitions sums its cells in
+    //  the same order on every rank.
+    const uint n_nodes = nodesX.size();
+    std::vector<uint> original(nRealCells);
+    for (auto& keyval : currentToOriginalCells) {
+        if (keyval.first < nRealCells) original[keyval.first] = keyval.second;
+    }
+
+    nodesCellsStart.assign(n_nodes + 1, 0);
+    for (uint i=0; i<nRealCells; ++i) {
+        const uint cell_size = cellsIsTriangle[i] ? 3 : 4;
+        for (uint j=0; j<cell_size; ++j) {
+            nodesCellsStart[cellsNodes(i, j) + 1] += 1;
+        }
+    }
+    for (uint n=0; n<n_nodes; ++n) {
+        nodesCellsStart[n+1] += nodesCellsStart[n];
+    }
+    nodesCells.resize(nodesCellsStart[n_nodes]);
+    std::vector<uint> fill(nodesCellsStart.begin(), nodesCellsStart.end() - 1);
+    for (uint i=0; i<nRealCells; ++i) {
+        const uint cell_size = cellsIsTriangle[i] ? 3 : 4;
+        for (uint j=0; j<cell_size; ++j) {
+            const uint n = cellsNodes(i, j);
+            nodesCells[fill[n]++] = i;
+        }
+    }
+
+    nodesCellsWeights.resize(nodesCells.size());
+    for (uint n=0; n<n_nodes; ++n) {
+        auto begin = nodesCells.begin() + nodesCellsStart[n];
+        auto end = nodesCells.begin() + nodesCellsStart[n+1];
+        std::sort(begin, end, [&](const uint a, const uint b) {
+            return original[a] < original[b];
+        });
+        double sum = 0.;
+        for (uint k=nodesCellsStart[n]; k<nodesCellsStart[n+1]; ++k) {
+            const uint i = nodesCells[k];
+            const double dx = cellsCentersX[i] - nodesX[n];
+            const double dy = cellsCentersY[i] - nodesY[n];
+            nodesCellsWeights[k] = 1./sqrt(dx*dx + dy*dy);
+            sum += nodesCellsWeights[k];
+        }
+        for (uint k=nodesCellsStart[n]; k<nodesCellsStart[n+1]; ++k) {
+            nodesCellsWeights[k] /= sum;
+        }
+    }
+}
+
+
+
+void mesh::make_nodes_comms() {
+    // Ghost cells are all the cells sharing a node with the partition, so
+    //  nodes of owned cells have all their cells. Nodes of ghost cells only
+    //  are received from the owner of one of these cells, requested by tag.
+    std::vector<uint> nodesTag(nodesX.size());
+    for (auto& keyval : originalNodesRef) {
+        nodesTag[keyval.second] = keyval.first;
+    }
+    std::map<uint, uint> ghostOwner;
+    for (uint g=0; g<ghostCellsCurrentIndices.size(); ++g) {
+        ghostOwner[ghostCellsCurrentIndices[g]] = ghostCellsOwners[g];
+    }
+
+    nodesComms.resize(comms.size());
+    for (uint c=0; c<comms.size(); ++c) {
+        nodesComms[c].out_rank = comms[c].out_rank;
+    }
+    std::vector<std::vector<uint>> requested(comms.size());
+    for (uint n=0; n<nodesX.size(); ++n) {
+        bool owned = false;
+        uint owner = std::numeric_limits<uint>::max();
+        for (uint k=nodesCellsStart[n]; k<nodesCellsStart[n+1]; ++k) {
+            const uint i = nodesCells[k];
+            if (!cellsIsGhost[i]) {
+                owned = true;
+                break;
+            }
+            owner = std::min(owner, ghostOwner.at(i));
+        }
+        if (owned | (nodesCellsStart[n] == nodesCellsStart[n+1])) continue;
+        for (uint c=0; c<comms.size(); ++c) {
+            if (comms[c].out_rank == owner) {
+                nodesComms[c].rec_nodes.push_back(n);
+                requested[c].push_back(nodesTag[n]);
+            }
+        }
+    }
+
+    // Exchange the requested tags, then map them to local nodes
+    std::vector<MPI_Request> reqs(2*comms.size());
+    std::vector<uint> sizes(comms.size());
+    for (uint c=0; c<comms.size(); ++c) {
+        const uint this_size = requested[c].size();
+        MPI_Isend(&this_size, 1, MPI_UNSIGNED, nodesComms[c].out_rank, 1, MPI_COMM_WORLD, &reqs[c]);
+        MPI_Recv(&sizes[c], 1, MPI_UNSIGNED, nodesComms[c].out_rank, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Wait(&reqs[c], MPI_STATUS_IGNORE);
+    }
+    for (uint c=0; c<comms.size(); ++c) {
+        auto& comm = nodesComms[c];
+        comm.snd_nodes.resize(sizes[c]);
+        MPI_Isend(requested[c].data(), requested[c].size(), MPI_UNSIGNED, comm.out_rank, 1, MPI_COMM_WORLD, &reqs[c]);
+    }
+    for (uint c=0; c<comms.size(); ++c) {
+        auto& comm = nodesComms[c];
+        MPI_Recv(comm.snd_nodes.data(), comm.snd_nodes.size(), MPI_UNSIGNED, comm.out_rank, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        for (auto& n : comm.snd_nodes) {
+            n = originalNodesRef.at(n);
+        }
+        comm.snd_q.resize(vars*comm.snd_nodes.size());
+        comm.rec_q.resize(vars*comm.rec_nodes.size());
+    }
+    MPI_Waitall(comms.size(), reqs.data(), MPI_STATUSES_IGNORE);
+}
+
+
+
 void mesh::make_comms(uint rank) {
     // Make communicators
 
@@ -801,7 +948,6 @@ void mesh::make_comms(uint rank) {
 
 
 void mesh::read_file(std::string name, mpi_wrapper& pool) {
-    uint rank = pool.rank;
 
     filename = "";
     filename += (pool.size > 1) ? (name + "_" + std::to_string(pool.rank + 1) + ".msh") : name + ".msh";
@@ -814,8 +960,175 @@ void mesh::read_file(std::string name, mpi_wrapper& pool) {
     read_elements();
     read_ghost_elements();
 
+    build(pool);
+}
+
+
+
+void mesh::generate(const generatorOptions& opt, mpi_wrapper& pool) {
+    // Generate this rank's strip of a rectangle, with the same cells, nodes,
+    //  boundary edges and ghost cells as a partitioned gmsh file would hold
+    const uint nx = opt.nx;
+    const uint ny = opt.ny;
+    const uint per_quad = opt.triangles ? 2 : 1;
+    const uint size = pool.size;
+    const uint rank = pool.rank;
+
+    if ((nx == 0) || (ny == 0)) {
+        throw std::invalid_argument("generated mesh needs at least one cell in each direction");
+    }
+    if (nx < size) {
+        throw std::invalid_argument("generated mesh has " + std::to_string(nx) + " columns for " + std::to_string(size) + " ranks");
+    }
+    if ((opt.jitter < 0.) || (opt.jitter >= 0.25)) {
+        throw std::invalid_argument("generated mesh jitter must be in [0, 0.25)");
+    }
+
+    filename = "";
+    physicalNames = {{1, "bottom"}, {2, "right"}, {3, "top"}, {4, "left"}};
+
+    // Original tags, shuffled identically on every rank
+    const uint n_cells = nx*ny*per_quad;
+    const uint n_nodes = (nx + 1)*(ny + 1);
+    std::vector<uint> cellTags(n_cells);
+    std::vector<uint> nodeTags(n_nodes);
+    for (uint i=0; i<n_cells; ++i) cellTags[i] = i;
+    for (uint i=0; i<n_nodes; ++i) nodeTags[i] = i;
+    if (opt.shuffle) {
+        std::mt19937 gen(opt.seed);
+        std::shuffle(cellTags.begin(), cellTags.end(), gen);
+        std::shuffle(nodeTags.begin(), nodeTags.end(), gen);
+    }
+
+    // Strips of columns, ghost cells are the columns on each side
+    auto owner = [&](const uint i) { return (uint) (((uint64_t) i*size)/nx); };
+    uint i0 = 0;
+    while (owner(i0) < rank) i0 += 1;
+    uint i1 = i0;
+    while ((i1 < nx) && (owner(i1) == rank)) i1 += 1;
+    const uint c0 = (i0 > 0) ? i0 - 1 : 0;
+    const uint c1 = (i1 < nx) ? i1 + 1 : nx;
+
+    // Nodes, stored by tag
+    auto node = [&](const uint i, const uint j) { return j*(nx + 1) + i; };
+    std::vector<std::tuple<uint, uint, uint>> nodes;
+    nodes.reserve((c1 - c0 + 1)*(ny + 1));
+    for (uint j=0; j<=ny; ++j) {
+        for (uint i=c0; i<=c1; ++i) {
+            nodes.push_back(std::make_tuple(nodeTags[node(i, j)], i, j));
+        }
+    }
+    std::sort(nodes.begin(), nodes.end());
+    const double hx = opt.lx/nx;
+    const double hy = opt.ly/ny;
+    std::vector<uint> localNode(n_nodes);
+    nodesX.resize(nodes.size());
+    nodesY.resize(nodes.size());
+    for (uint k=0; k<nodes.size(); ++k) {
+        const uint i = std::get<1>(nodes[k]);
+        const uint j = std::get<2>(nodes[k]);
+        localNode[node(i, j)] = k;
+        originalNodesRef[std::get<0>(nodes[k])] = k;
+
+        // Deterministic displacement of the interior nodes
+        uint64_t h = ((uint64_t) opt.seed << 32) ^ node(i, j);
+        double r[2];
+        for (uint d=0; d<2; ++d) {
+            h += 0x9e3779b97f4a7c15ULL;
+            uint64_t z = h;
+            z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+            z = z ^ (z >> 31);
+            r[d] = (z >> 11)*(1./9007199254740992.) - 0.5;
+        }
+        const bool moves_x = (i > 0) && (i < nx);
+        const bool moves_y = (j > 0) && (j < ny);
+        nodesX[k] = hx*i + (moves_x ? 2.*opt.jitter*hx*r[0] : 0.);
+        nodesY[k] = hy*j + (moves_y ? 2.*opt.jitter*hy*r[1] : 0.);
+    }
+
+    // Cells, stored by tag, with alternating diagonals for triangles
+    std::vector<std::tuple<uint, uint, uint, uint>> cells;
+    cells.reserve((c1 - c0)*ny*per_quad);
+    for (uint j=0; j<ny; ++j) {
+        for (uint i=c0; i<c1; ++i) {
+            for (uint t=0; t<per_quad; ++t) {
+                cells.push_back(std::make_tuple(cellTags[(j*nx + i)*per_quad + t], i, j, t));
+            }
+        }
+    }
+    std::sort(cells.begin(), cells.end());
+    for (auto& cell : cells) {
+        const uint tag = std::get<0>(cell);
+        const uint i = std::get<1>(cell);
+        const uint j = std::get<2>(cell);
+        const uint t = std::get<3>(cell);
+        const uint a = localNode[node(i, j)];
+        const uint b = localNode[node(i+1, j)];
+        const uint c = localNode[node(i+1, j+1)];
+        const uint d = localNode[node(i, j+1)];
+
+        currentToOriginalCells[cellsIsTriangle.size()] = tag;
+        originalToCurrentCells[tag] = cellsIsTriangle.size();
+
+        if (!opt.triangles) {
+            cellsNodes.push_back({a, b, c, d});
+        } else if ((i + j) % 2 == 0) {
+            cellsNodes.push_back((t == 0) ? std::vector<uint>{a, b, c, 0} : std::vector<uint>{a, c, d, 0});
+        } else {
+            cellsNodes.push_back((t == 0) ? std::vector<uint>{a, b, d, 0} : std::vector<uint>{b, c, d, 0});
+        }
+        cellsIsTriangle.push_back(opt.triangles);
+
+        cellsAreas.push_back(0.);
+        cellsCentersX.push_back(0.);
+        cellsCentersY.push_back(0.);
+        cellsIsGhost.push_back(owner(i) != rank);
+
+        if (owner(i) != rank) {
+            ghostCellsOriginalIndices.push_back(tag);
+            ghostCellsCurrentIndices.push_back(cellsIsTriangle.size() - 1);
+            ghostCellsOwners.push_back(owner(i));
+        }
+    }
+
+    // Boundary edges of the owned cells
+    for (uint i=i0; i<i1; ++i) {
+        boundaryEdges0.push_back(localNode[node(i, 0)]);
+        boundaryEdges1.push_back(localNode[node(i+1, 0)]);
+        boundaryEdgesIntTag.push_back(1);
+    }
+    if (i1 == nx) {
+        for (uint j=0; j<ny; ++j) {
+            boundaryEdges0.push_back(localNode[node(nx, j)]);
+            boundaryEdges1.push_back(localNode[node(nx, j+1)]);
+            boundaryEdgesIntTag.push_back(2);
+        }
+    }
+    for (uint i=i0; i<i1; ++i) {
+        boundaryEdges0.push_back(localNode[node(i+1, ny)]);
+        boundaryEdges1.push_back(localNode[node(i, ny)]);
+        boundaryEdgesIntTag.push_back(3);
+    }
+    if (i0 == 0) {
+        for (uint j=0; j<ny; ++j) {
+            boundaryEdges0.push_back(localNode[node(0, j+1)]);
+            boundaryEdges1.push_back(localNode[node(0, j)]);
+            boundaryEdgesIntTag.push_back(4);
+        }
+    }
+
+    build(pool);
+}
+
+
+
+void mesh::build(mpi_wrapper& pool) {
+    // Edges, metrics, boundary cells and communicators of the cells read
+    //  from a file or generated
+
     // Generate communicators
-    make_comms(rank);
+    make_comms(pool.rank);
 
     // Add all cells edges
     for (uint i=0; i<cellsAreas.size(); ++i) {
@@ -852,6 +1165,13 @@ void mesh::read_file(std::string name, mpi_wrapper& pool) {
     // Add boundary cells
     add_boundary_cells();
 
+    // Cell to edges connectivity
+    compute_cells_edges();
+
+    // Node to cells connectivity and interpolation weights
+    compute_nodes_cells();
+    if (pool.size > 1) make_nodes_comms();
+
 }
 
 
@@ -0,0 +1,273 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : In-situ monitors sources
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#include <fvhyper/monitor.h>
+#include <fvhyper/explicit.h>
+#include <fvhyper/post.h>
+#include <cmath>
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+
+namespace fvhyper {
+
+
+void force_monitor::init(mesh& m, mpi_wrapper& pool) {
+    // Boundary edges of the monitored physical names on owned cells
+    edges.clear();
+    for (uint b=0; b<m.boundaryEdges.size(); ++b) {
+        const std::string& bname = m.physicalNames.at(m.boundaryEdgesIntTag[b]);
+        const uint e = m.boundaryEdges[b];
+        if (m.cellsIsGhost[m.edgesCells(e, 0)]) continue;
+        if (std::find(boundaries.begin(), boundaries.end(), bname) != boundaries.end()) {
+            edges.push_back(e);
+        }
+    }
+    if ((momentum_x >= vars) | (momentum_y >= vars)) {
+        throw std::invalid_argument("force_monitor momentum indices out of range");
+    }
+    history.clear();
+
+    if (pool.rank == 0) {
+        // A restart continues the history written before the checkpoint
+        out.open(filename, restarted ? std::ios::app : std::ios::out);
+        if (!out) {
+            throw std::invalid_argument("could not open monitor file " + filename);
+        }
+        if (!restarted) out << "step,time,fx,fy,moment,cd,cl,cm\n";
+        out << std::setprecision(10);
+    }
+}
+
+
+void force_monitor::update(
+    const uint step,
+    const double time,
+    std::vector<double>& q,
+    const residual_operator& residual,
+    mesh& m,
+    mpi_wrapper& pool
+) {
+    double local[3] = {0., 0., 0.};
+    double f[vars];
+    for (auto e : edges) {
+        calc_edge_flux(f, e, q, residual.gx, residual.gy, residual.limiters, m);
+        const double l = m.edgesLengths[e];
+        const double fx = f[momentum_x]*l;
+        const double fy = f[momentum_y]*l;
+        local[0] += fx;
+        local[1] += fy;
+        local[2] += (m.edgesCentersX[e] - moment_x)*fy - (m.edgesCentersY[e] - moment_y)*fx;
+    }
+    MPI_Allreduce(local, loads.data(), 3, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+    // Drag along the free stream direction, lift normal to it
+    const double ca = cos(alpha);
+    const double sa = sin(alpha);
+    const double s = reference_pressure*reference_length;
+    coefficients[0] = (loads[0]*ca + loads[1]*sa)/s;
+    coefficients[1] = (loads[1]*ca - loads[0]*sa)/s;
+    coefficients[2] = loads[2]/(s*reference_length);
+
+    history.push_back(coefficients);
+    if (history.size() > window) history.pop_front();
+
+    if (pool.rank == 0) {
+        out << step << "," << time;
+        for (auto v : loads) out << "," << v;
+        for (auto v : coefficients) out << "," << v;
+        out << "\n";
+        out.flush();
+    }
+}
+
+
+bool force_monitor::converged() const {
+    if ((tolerance <= 0.) | (history.size() < window)) return false;
+    for (uint k=0; k<3; ++k) {
+        double cmin = history[0][k];
+        double cmax = history[0][k];
+        for (auto& c : history) {
+            cmin = std::min(cmin, c[k]);
+            cmax = std::max(cmax, c[k]);
+        }
+        if (cmax - cmin > tolerance) return false;
+    }
+    return true;
+}
+
+
+void force_monitor::finish() {
+    if (out.is_open()) out.close();
+}
+
+
+
+
+std::vector<std::string> probe_monitor::field_names() const {
+    std::vector<std::string> names = var_names;
+    for (auto& keyval : post::extra_scalars) {
+        names.push_back(keyval.first);
+    }
+    return names;
+}
+
+
+void probe_monitor::init(mesh& m, mpi_wrapper& pool) {
+    if (x.size() != y.size()) {
+        throw std::invalid_argument("probe_monitor x and y sizes differ");
+    }
+    locator.build(m);
+    locator.locate(cells, x, y);
+
+    // Points on partition interfaces are kept by the lowest rank
+    owners.resize(x.size());
+    std::vector<int> found(x.size());
+    for (uint p=0; p<x.size(); ++p) {
+        found[p] = (cells[p] >= 0) ? pool.rank : pool.size;
+    }
+    MPI_Allreduce(found.data(), owners.data(), x.size(), MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    for (uint p=0; p<x.size(); ++p) {
+        if (owners[p] != pool.rank) cells[p] = -1;
+    }
+
+    fields = field_names().size();
+    values.assign(fields*x.size(), 0.);
+
+    if (pool.rank == 0) {
+        for (uint p=0; p<x.size(); ++p) {
+            if (owners[p] == pool.size) {
+                std::cout << "Probe point (" << x[p] << ", " << y[p] << ") is outside the mesh" << std::endl;
+            }
+        }
+        out.open(filename, restarted ? std::ios::app : std::ios::out);
+        if (!out) {
+            throw std::invalid_argument("could not open monitor file " + filename);
+        }
+        out << std::setprecision(10);
+        if (!restarted) write_header();
+    }
+}
+
+
+void probe_monitor::update(
+    const uint step,
+    const double time,
+    std::vector<double>& q,
+    const residual_operator& residual,
+    mesh& m,
+    mpi_wrapper& pool
+) {
+    // Samples of the owned points, points outside the mesh are NaN
+    std::vector<double> local(fields*x.size(), 0.);
+    double qp[vars];
+    for (uint p=0; p<x.size(); ++p) {
+        const int i = cells[p];
+        if (i < 0) continue;
+        const double dx = x[p] - m.cellsCentersX[i];
+        const double dy = y[p] - m.cellsCentersY[i];
+        for (uint k=0; k<vars; ++k) {
+            const uint ik = vars*i + k;
+            qp[k] = q[ik] + residual.gx[ik]*dx + residual.gy[ik]*dy;
+            local[fields*p + k] = qp[k];
+        }
+        uint k = vars;
+        for (auto& keyval : post::extra_scalars) {
+            keyval.second(&local[fields*p + k], qp);
+            k += 1;
+        }
+    }
+    MPI_Reduce(local.data(), values.data(), local.size(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    if (pool.rank == 0) {
+        for (uint p=0; p<x.size(); ++p) {
+            if (owners[p] != pool.size) continue;
+            for (uint k=0; k<fields; ++k) {
+                values[fields*p + k] = std::nan("");
+            }
+        }
+        write_values(step, time);
+        out.flush();
+    }
+}
+
+
+void probe_monitor::write_header() {
+    out << "step,time";
+    for (uint p=0; p<x.size(); ++p) {
+        for (auto& name : field_names()) {
+            out << "," << name << "_" << p;
+        }
+    }
+    out << "\n";
+}
+
+
+void probe_monitor::write_values(const uint step, const double time) {
+    out << step << "," << time;
+    for (auto v : values) {
+        out << "," << v;
+    }
+    out << "\n";
+}
+
+
+void probe_monitor::finish() {
+    if (out.is_open()) out.close();
+}
+
+
+
+line_monitor::line_monitor() {
+    filename = "line.csv";
+}
+
+
+void line_monitor::init(mesh& m, mpi_wrapper& pool) {
+    x.resize(points);
+    y.resize(points);
+    for (uint p=0; p<points; ++p) {
+        const double t = (points > 1) ? ((double) p)/(points - 1) : 0.;
+        x[p] = x0 + t*(x1 - x0);
+        y[p] = y0 + t*(y1 - y0);
+    }
+    probe_monitor::init(m, pool);
+}
+
+
+void line_monitor::write_header() {
+    out << "step,time,s,x,y";
+    for (auto& name : field_names()) {
+        out << "," << name;
+    }
+    out << "\n";
+}
+
+
+void line_monitor::write_values(const uint step, const double time) {
+    for (uint p=0; p<x.size(); ++p) {
+        const double s = sqrt((x[p] - x0)*(x[p] - x0) + (y[p] - y0)*(y[p] - y0));
+        out << step << "," << time << "," << s << "," << x[p] << "," << y[p];
+        for (uint k=0; k<fields; ++k) {
+            out << "," << values[fields*p + k];
+        }
+        out << "\n";
+    }
+}
+
+
+
+}
@@ -14,18 +14,385 @@
 
 */
 #include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
 #include <fvhyper/post.h>
+#include <zlib.h>
 
 namespace fvhyper {
 
-void writeVtk(
+
+namespace post {
+
+binary_writer::binary_writer(const std::string filename_, const size_t buffer_size) {
+    filename = filename_;
+    out.open(filename, std::ios::binary);
+    if (!out) {
+        throw std::invalid_argument("could not open output file " + filename);
+    }
+    buffer.resize(buffer_size);
+}
+
+binary_writer::~binary_writer() {
+    try {
+        close();
+    } catch (const std::runtime_error&) {
+        // Already unwinding or never closed, the file is left truncated
+    }
+}
+
+void binary_writer::check() {
+    if (!out) {
+        throw std::runtime_error("could not write output file " + filename);
+    }
+}
+
+void binary_writer::write(const void* data, const size_t bytes) {
+    if (used + bytes > buffer.size()) {
+        flush();
+        if (bytes > buffer.size()) {
+            // Large blocks bypass the buffer
+            out.write((const char*) data, bytes);
+            check();
+            return;
+        }
+    }
+    std::memcpy(&buffer[used], data, bytes);
+    used += bytes;
+}
+
+void binary_writer::write(const std::string& s) {
+    write(s.data(), s.size());
+}
+
+void binary_writer::flush() {
+    if (used > 0) {
+        out.write(buffer.data(), used);
+        used = 0;
+        check();
+    }
+}
+
+void binary_writer::close() {
+    if (out.is_open()) {
+        flush();
+        out.close();
+        check();
+    }
+}
+
+
+zlib_encoder::zlib_encoder(const int level_, const size_t block_size_) {
+    level = level_;
+    block_size = block_size_;
+    block.reserve(block_size);
+}
+
+void zlib_encoder::write(const void* values, const size_t bytes) {
+    const char* c = (const char*) values;
+    size_t done = 0;
+    while (done < bytes) {
+        const size_t n = std::min(bytes - done, block_size - block.size());
+        block.insert(block.end(), c + done, c + done + n);
+        done += n;
+        if (block.size() == block_size) compress_block();
+    }
+    raw_bytes += bytes;
+}
+
+void zlib_encoder::compress_block() {
+    uLongf compressed = compressBound(block.size());
+    const size_t start = data.size();
+    data.resize(start + compressed);
+    if (compress2((Bytef*) &data[start], &compressed, (const Bytef*) block.data(), block.size(), level) != Z_OK) {
+        throw std::invalid_argument("zlib compression failed");
+    }
+    data.resize(start + compressed);
+    header.push_back(compressed);
+    block.clear();
+}
+
+void zlib_encoder::finish() {
+    if (block.size() > 0) compress_block();
+    const uint64_t blocks = header.size();
+    const uint64_t last = raw_bytes % block_size;
+    header.insert(header.begin(), {blocks, block_size, last});
+}
+
+uint64_t zlib_encoder::size() const {
+    return header.size()*sizeof(uint64_t) + data.size();
+}
+
+
+bool little_endian() {
+    const uint16_t one = 1;
+    return *((const uint8_t*) &one) == 1;
+}
+
+}
+
+
+
+/*
+    Appended data array of the vtu files
+*/
+struct vtk_array {
+    std::string name;
+    std::string type;
+    uint components;
+    uint64_t bytes;
+};
+
+
+static std::string vtk_real_type(const bool float64) {
+    return float64 ? "Float64" : "Float32";
+}
+
+
+/*
+    Arrays of a vtu piece in appended data order : points, connectivity,
+    offsets, types, rank, then the cell fields from vtk_fields_start and
+    the point fields if point_data
+*/
+static const uint vtk_fields_start = 5;
+
+static uint vtk_fields_count() {
+    return var_names.size() + post::extra_scalars.size() + post::extra_vectors.size();
+}
+
+static std::vector<vtk_array> vtk_arrays(mesh& m, const bool float64, const bool point_data = false) {
+    const std::string real = vtk_real_type(float64);
+    const uint64_t real_size = float64 ? sizeof(double) : sizeof(float);
+    const uint64_t nPoints = m.nodesX.size();
+    const uint64_t nCells = m.nRealCells;
+    uint64_t nConnectivity = 0;
+    for (uint i=0; i<m.nRealCells; ++i) {
+        nConnectivity += m.cellsIsTriangle[i] ? 3 : 4;
+    }
+
+    std::vector<vtk_array> arrays;
+    arrays.push_back({"", real, 3, 3*nPoints*real_size});
+    arrays.push_back({"connectivity", "Int32", 1, nConnectivity*sizeof(int32_t)});
+    arrays.push_back({"offsets", "Int32", 1, nCells*sizeof(int32_t)});
+    arrays.push_back({"types", "UInt8", 1, nCells*sizeof(uint8_t)});
+    arrays.push_back({"rank", "Int32", 1, nCells*sizeof(int32_t)});
+    for (auto varname : var_names) {
+        arrays.push_back({varname, real, 1, nCells*real_size});
+    }
+    for (auto& keyval : post::extra_scalars) {
+        arrays.push_back({keyval.first, real, 1, nCells*real_size});
+    }
+    for (auto& keyval : post::extra_vectors) {
+        arrays.push_back({keyval.first, real, 3, 3*nCells*real_size});
+    }
+    if (point_data) {
+        for (uint k=vtk_fields_start; k<vtk_fields_start + vtk_fields_count(); ++k) {
+            auto a = arrays[k];
+            a.bytes = a.bytes/nCells*nPoints;
+            arrays.push_back(a);
+        }
+    }
+    return arrays;
+}
+
+
+/*
+    Round v to the nearest multiple of the largest power of two not above
+    2*tolerance, so |error| <= tolerance and the low mantissa bits are zero
+*/
+static double quantize(const double v, const double tolerance) {
+    if (tolerance <= 0.) return v;
+    const double step = std::exp2(std::floor(std::log2(2.*tolerance)));
+    return step*std::nearbyint(v/step);
+}
+
+
+template<typename W>
+static void write_real(W& w, const double v, const bool float64) {
+    if (float64) {
+        w.put(v);
+    } else {
+        w.put((float) v);
+    }
+}
+
+
+/*
+    Write the values of field f, in variables, extra scalars then extra
+    vectors order, for the n entities of q
+*/
+template<typename W>
+static void write_vtk_field(
+    W& w,
+    const uint f,
+    const std::vector<double>& q,
+    const uint n,
+    const bool float64,
+    const double tolerance
+) {
+    const uint nvars = var_names.size();
+    if (f < nvars) {
+        for (uint j=0; j<n; ++j) {
+            write_real(w, quantize(q[nvars*j + f], tolerance), float64);
+        }
+    } else if (f < nvars + post::extra_scalars.size()) {
+        auto& func = std::next(post::extra_scalars.begin(), f - nvars)->second;
+        for (uint j=0; j<n; ++j) {
+            double scal_i[1];
+            func(scal_i, (double*) &q[nvars*j]);
+            write_real(w, quantize(scal_i[0], tolerance), float64);
+        }
+    } else {
+        // Vectors
+        auto& func = std::next(
+            post::extra_vectors.begin(), f - nvars - post::extra_scalars.size()
+        )->second;
+        for (uint j=0; j<n; ++j) {
+            double vec_i[2];
+            func(vec_i, (double*) &q[nvars*j]);
+            write_real(w, quantize(vec_i[0], tolerance), float64);
+            write_real(w, quantize(vec_i[1], tolerance), float64);
+            write_real(w, 0., float64);
+        }
+    }
+}
+
+
+/*
+    Write the values of array k of vtk_arrays, fields are quantized to the
+    given absolute tolerance if it is positive. Point fields use the node
+    values qn.
+*/
+template<typename W>
+static void write_vtk_array(
+    W& w,
+    const uint k,
+    std::vector<double>& q,
+    const std::vector<double>& qn,
+    mesh& m,
+    const int rank,
+    const bool float64,
+    const double tolerance = 0.
+) {
+    if (k == 0) {
+        for (uint i=0; i<m.nodesX.size(); ++i) {
+            write_real(w, m.nodesX[i], float64);
+            write_real(w, m.nodesY[i], float64);
+            write_real(w, 0., float64);
+        }
+    } else if (k == 1) {
+        for (uint i=0; i<m.nRealCells; ++i) {
+            const uint nNodes = m.cellsIsTriangle[i] ? 3 : 4;
+            for (uint n=0; n<nNodes; ++n) {
+                w.template put<int32_t>(m.cellsNodes(i, n));
+            }
+        }
+    } else if (k == 2) {
+        int32_t current_offset = 0;
+        for (uint i=0; i<m.nRealCells; ++i) {
+            current_offset += m.cellsIsTriangle[i] ? 3 : 4;
+            w.template put<int32_t>(current_offset);
+        }
+    } else if (k == 3) {
+        for (uint i=0; i<m.nRealCells; ++i) {
+            // Tri cell 5, quad cell 9
+            w.template put<uint8_t>(m.cellsIsTriangle[i] ? 5 : 9);
+        }
+    } else if (k == 4) {
+        for (uint j=0; j<m.nRealCells; ++j) {
+            w.template put<int32_t>(rank);
+        }
+    } else if (k < vtk_fields_start + vtk_fields_count()) {
+        write_vtk_field(w, k - vtk_fields_start, q, m.nRealCells, float64, tolerance);
+    } else {
+        write_vtk_field(w, k - vtk_fields_start - vtk_fields_count(), qn, m.nodesX.size(), float64, tolerance);
+    }
+}
+
+
+/*
+    Variables, extra scalars and extra vectors of the cells, back to back
+*/
+static void write_cell_fields(
+    post::binary_writer& w,
+    std::vector<double>& q,
+    mesh& m,
+    const bool float64
+) {
+    const uint nArrays = vtk_fields_start + vtk_fields_count();
+    for (uint k=vtk_fields_start; k<nArrays; ++k) {
+        write_vtk_array(w, k, q, {}, m, 0, float64);
+    }
+}
+
+
+void interpolate_nodes(
+    std::vector<double>& qn,
+    std::vector<double>& q,
+    mesh& m
+) {
+    const uint nNodes = m.nodesX.size();
+    qn.assign(vars*nNodes, 0.);
+    for (uint n=0; n<nNodes; ++n) {
+        for (uint k=m.nodesCellsStart[n]; k<m.nodesCellsStart[n+1]; ++k) {
+            const double w = m.nodesCellsWeights[k];
+            const uint i = m.nodesCells[k];
+            for (uint j=0; j<vars; ++j) {
+                qn[vars*n + j] += w*q[vars*i + j];
+            }
+        }
+    }
+
+    // Nodes of partition ghost cells only take the value of their owner
+    std::vector<MPI_Request> reqs(m.nodesComms.size());
+    for (uint c=0; c<m.nodesComms.size(); ++c) {
+        auto& comm = m.nodesComms[c];
+        for (uint k=0; k<comm.snd_nodes.size(); ++k) {
+            for (uint j=0; j<vars; ++j) {
+                comm.snd_q[vars*k + j] = qn[vars*comm.snd_nodes[k] + j];
+            }
+        }
+        MPI_Isend(
+            comm.snd_q.data(), comm.snd_q.size(), MPI_DOUBLE, comm.out_rank, 1, MPI_COMM_WORLD, &reqs[c]
+        );
+    }
+    for (auto& comm : m.nodesComms) {
+        MPI_Recv(
+            comm.rec_q.data(), comm.rec_q.size(), MPI_DOUBLE, comm.out_rank, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE
+        );
+        for (uint k=0; k<comm.rec_nodes.size(); ++k) {
+            for (uint j=0; j<vars; ++j) {
+                qn[vars*comm.rec_nodes[k] + j] = comm.rec_q[vars*k + j];
+            }
+        }
+    }
+    MPI_Waitall(reqs.size(), reqs.data(), MPI_STATUSES_IGNORE);
+}
+
+
+post::output_stats writeVtk(
     const std::string name,
     std::vector<double>& q,
     mesh& m,
     int rank,
     int world_size,
-    const std::string time
+    const std::string time,
+    const bool float64,
+    const post::compression& compression,
+    const bool point_data
 ) {
+    auto begin = std::chrono::steady_clock::now();
+
+    std::vector<double> qn;
+    if (point_data) interpolate_nodes(qn, q, m);
+
     std::string dash_time = (time == "") ? "" : "_" + time;
 
     std::string filename =
@@ -35,8 +402,20 @@ void writeVtk(
     
     if (time != "") {
         filename = "times/" + filename;
+        std::filesystem::create_directories("times");
     }
 
+    const std::string real = vtk_real_type(float64);
+    const std::string byte_order = post::little_endian() ? "LittleEndian" : "BigEndian";
+    const std::string compressor = (compression.level > 0) ? " compressor=\"vtkZLibDataCompressor\"" : "";
+
+    std::vector<vtk_array> arrays = vtk_arrays(m, float64, point_data);
+    const uint nCellArrays = vtk_fields_start + vtk_fields_count();
+    auto tolerance = [&](const vtk_array& a) {
+        auto it = compression.tolerances.find(a.name);
+        return (it == compression.tolerances.end()) ? 0. : it->second;
+    };
+
     if ((rank == 0)&(world_size > 1)) {
         std::string coreFileName = name + "_parallel" + dash_time + ".pvtu";
         if (time != "") {
@@ -44,30 +423,34 @@ void writeVtk(
         }
         // Write vtk header file
         std::string core = "";
-        core += "<VTKFile type=\"PUnstructuredGrid\" version=\"0.1\" byte_order=\"BigEndian\">\n";
+        core += "<VTKFile type=\"PUnstructuredGrid\" version=\"1.0\" byte_order=\"" + byte_order + "\" header_type=\"UInt64\"" + compressor + ">\n";
         core += "<PUnstructuredGrid GhostLevel=\"1\">\n";
         core += "  <PPoints>\n";
-        core += "    <PDataArray type=\"Float32\" NumberOfComponents=\"3\"/>\n";
+        core += "    <PDataArray type=\"" + real + "\" NumberOfComponents=\"3\"/>\n";
         core += "  </PPoints>\n";
         core += "  <PCells>\n";
         core += "    <PDataArray type=\"Int32\" Name=\"connectivity\"/>\n";
         core += "    <PDataArray type=\"Int32\" Name=\"offsets\"/>\n";
-        core += "    <PDataArray type=\"Int32\" Name=\"types\"/>\n";
+        core += "    <PDataArray type=\"UInt8\" Name=\"types\"/>\n";
         core += "  </PCells>\n";
+        auto pdata_array = [&](const uint k) {
+            auto& a = arrays[k];
+            core += "    <PDataArray type=\"" + a.type + "\" Name=\"" + a.name + "\"";
+            if (a.components > 1) core += " NumberOfComponents=\"" + std::to_string(a.components) + "\"";
+            core += "/>\n";
+        };
         core += "  <PCellData Scalars=\"scalars\">\n";
-        core += "    <PDataArray type=\"Float32\" Name=\"rank\"/>\n";
-        for (auto varname : var_names) {
-            core += "    <PDataArray type=\"Float32\" Name=\"" + varname + "\"/>\n";
-        }
-        for (auto& keyval : post::extra_scalars) {
-            core += "    <PDataArray type=\"Float32\" Name=\"" + keyval.first + "\"/>\n";
+        for (uint k=4; k<nCellArrays; ++k) {
+            pdata_array(k);
         }
-        if (post::extra_vectors.size() > 0) {
-            for (auto& keyval : post::extra_vectors) {
-                core += "    <PDataArray type=\"Float32\" Name=\"" + keyval.first + "\" NumberOfComponents=\"3\"/>\n";
+        core += "  </PCellData>\n";
+        if (point_data) {
+            core += "  <PPointData Scalars=\"scalars\">\n";
+            for (uint k=nCellArrays; k<arrays.size(); ++k) {
+                pdata_array(k);
             }
+            core += "  </PPointData>\n";
         }
-        core += "  </PCellData>\n";
         for (uint i=0; i<world_size; ++i) {
             std::string filename_i = name + "_" + std::to_string(i) + dash_time + ".vtu";
             core += "  <Piece Source=\"" + filename_i + "\"/>\n";
@@ -79,124 +462,909 @@ void writeVtk(
         out << core;
         out.close();
     }
-    // Write solution q to .vtk file filename
+
+    post::output_stats stats;
+
+    // Compressed arrays are encoded before the header, which holds their sizes
+    std::vector<post::zlib_encoder> encoded;
+    if (compression.level > 0) {
+        for (uint k=0; k<arrays.size(); ++k) {
+            encoded.emplace_back(compression.level);
+            write_vtk_array(encoded[k], k, q, qn, m, rank, float64, tolerance(arrays[k]));
+            encoded[k].finish();
+        }
+    }
+
+    // Xml header, each array is at an offset in the raw appended data
+    //  blocks are a UInt64 byte count followed by the values, or the
+    //  compression header followed by the compressed blocks
     std::string s = "";
+    uint64_t offset = 0;
+    auto data_array = [&](const uint k) {
+        auto& a = arrays[k];
+        s += "        <DataArray type=\"" + a.type + "\"";
+        if (a.name != "") s += " Name=\"" + a.name + "\"";
+        if (a.components > 1) s += " NumberOfComponents=\"" + std::to_string(a.components) + "\"";
+        s += " format=\"appended\" offset=\"" + std::to_string(offset) + "\"/>\n";
+        offset += (compression.level > 0) ? encoded[k].size() : sizeof(uint64_t) + a.bytes;
+        stats.raw_bytes += sizeof(uint64_t) + a.bytes;
+    };
 
-    s += "<VTKFile type=\"UnstructuredGrid\" version=\"0.1\" byte_order=\"BigEndian\">\n";
+    s += "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\"" + byte_order + "\" header_type=\"UInt64\"" + compressor + ">\n";
     s += "  <UnstructuredGrid>\n";
     s += "    <Piece NumberOfPoints=\"" + std::to_string(m.nodesX.size()) + "\" NumberOfCells=\"" + std::to_string(m.nRealCells) + "\">\n";
     s += "      <Points>\n";
-    s += "        <DataArray type=\"Float32\" NumberOfComponents=\"3\" Format=\"ascii\">\n";
-    for (uint i=0; i<m.nodesX.size(); ++i) {
-        s += "          " + std::to_string(m.nodesX[i]) + " " + std::to_string(m.nodesY[i]) + " 0.0\n";
-    }
-    s += "        </DataArray>\n";
+    data_array(0);
     s += "      </Points>\n";
-
-    // Figure out the total number of integer tags in the cells
     s += "      <Cells>\n";
-    s += "        <DataArray type=\"Int32\" Name=\"connectivity\" Format=\"ascii\">\n";
+    data_array(1);
+    data_array(2);
+    data_array(3);
+    s += "      </Cells>\n";
+    s += "      <CellData Scalars=\"scalars\">\n";
+    for (uint k=4; k<nCellArrays; ++k) {
+        data_array(k);
+    }
+    s += "      </CellData>\n";
+    if (point_data) {
+        s += "      <PointData Scalars=\"scalars\">\n";
+        for (uint k=nCellArrays; k<arrays.size(); ++k) {
+            data_array(k);
+        }
+        s += "      </PointData>\n";
+    }
+    s += "    </Piece>\n";
+    s += "  </UnstructuredGrid>\n";
+    s += "  <AppendedData encoding=\"raw\">\n_";
+    const std::string footer = "\n  </AppendedData>\n</VTKFile>\n";
+    stats.raw_bytes += s.size() + footer.size();
+    stats.file_bytes = s.size() + offset + footer.size();
+
+    post::binary_writer w(filename);
+    w.write(s);
+    for (uint k=0; k<arrays.size(); ++k) {
+        if (compression.level > 0) {
+            w.write(encoded[k].header.data(), encoded[k].header.size()*sizeof(uint64_t));
+            w.write(encoded[k].data.data(), encoded[k].data.size());
+        } else {
+            w.put<uint64_t>(arrays[k].bytes);
+            write_vtk_array(w, k, q, qn, m, rank, float64);
+        }
+    }
+    w.write(footer);
+    w.close();
 
-    // Add each cell
-    s += "          ";
-    for (int fi=0; fi<m.nRealCells; ++fi) {
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return stats;
+}
 
-        std::vector<uint> ns = {
-            m.cellsNodes(fi, 0),
-            m.cellsNodes(fi, 1),
-            m.cellsNodes(fi, 2)
-        };
-        if (!m.cellsIsTriangle[fi]) {
-            ns.push_back(m.cellsNodes(fi, 3));
+
+
+
+
+template<typename T>
+static void pack(std::vector<char>& buffer, const T v) {
+    const char* c = (const char*) &v;
+    buffer.insert(buffer.end(), c, c + sizeof(T));
+}
+
+
+static void pack_real(std::vector<char>& buffer, const double v, const bool float64) {
+    if (float64) {
+        pack(buffer, v);
+    } else {
+        pack(buffer, (float) v);
+    }
+}
+
+
+void writeVtkCollective(
+    const std::string name,
+    std::vector<double>& q,
+    mesh& m,
+    mpi_wrapper& pool,
+    const std::string time,
+    const bool float64
+) {
+    const int rank = pool.rank;
+    std::string filename = (time == "") ? name + ".vtu" : "times/" + name + "_" + time + ".vtu";
+    if (time != "") {
+        if (rank == 0) std::filesystem::create_directories("times");
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+
+    const std::string real = vtk_real_type(float64);
+    const uint64_t real_size = float64 ? sizeof(double) : sizeof(float);
+    const std::string byte_order = post::little_endian() ? "LittleEndian" : "BigEndian";
+    const uint nvars = var_names.size();
+
+    // Cells owned by this rank
+    std::vector<uint> cells;
+    uint64_t nConnectivity = 0;
+    for (uint i=0; i<m.nRealCells; ++i) {
+        if (!m.cellsIsGhost[i]) {
+            cells.push_back(i);
+            nConnectivity += m.cellsIsTriangle[i] ? 3 : 4;
         }
-        for (auto ni : ns) {
-            s += std::to_string(ni) + "  ";
+    }
+
+    // A node shared with other partitions is written by the lowest rank
+    //  owning a cell around it, as seen through the ghost cells
+    std::vector<uint64_t> nodesTag(m.nodesX.size());
+    for (auto& keyval : m.originalNodesRef) {
+        nodesTag[keyval.second] = keyval.first;
+    }
+    std::vector<int> nodesWriter(m.nodesX.size(), -1);
+    for (auto i : cells) {
+        for (uint k=0; k<(m.cellsIsTriangle[i] ? 3 : 4); ++k) {
+            nodesWriter[m.cellsNodes(i, k)] = rank;
+        }
+    }
+    for (uint g=0; g<m.ghostCellsCurrentIndices.size(); ++g) {
+        const uint i = m.ghostCellsCurrentIndices[g];
+        const int owner = m.ghostCellsOwners[g];
+        for (uint k=0; k<(m.cellsIsTriangle[i] ? 3 : 4); ++k) {
+            int& writer = nodesWriter[m.cellsNodes(i, k)];
+            if (writer >= 0) writer = std::min(writer, owner);
         }
-        s += "\n          ";
     }
-    s += "        </DataArray>\n";
+    std::vector<uint> nodes;
+    for (uint n=0; n<m.nodesX.size(); ++n) {
+        if (nodesWriter[n] == rank) nodes.push_back(n);
+    }
+    std::sort(nodes.begin(), nodes.end(), [&](const uint a, const uint b) {
+        return nodesTag[a] < nodesTag[b];
+    });
 
-    // Save cell offsets
-    s += "        <DataArray type=\"Int32\" Name=\"offsets\" Format=\"ascii\">\n";
-    s += "          ";
-    uint current_offset = 0;
-    for (uint i=0; i<m.nRealCells; ++i) {
-        current_offset += m.cellsIsTriangle[i] ? 3 : 4;
-        s += std::to_string(current_offset) + "  ";
+    // Global sizes and the offsets of this rank in each array
+    uint64_t local[3] = {cells.size(), nConnectivity, nodes.size()};
+    uint64_t before[3] = {0, 0, 0};
+    uint64_t total[3];
+    MPI_Exscan(local, before, 3, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        before[0] = 0;
+        before[1] = 0;
+        before[2] = 0;
     }
-    s += "\n";
-    s += "        </DataArray>\n";
+    MPI_Allreduce(local, total, 3, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    const uint64_t nCells = total[0];
+    const uint64_t nPoints = total[2];
 
-    // Write cell types
-    s += "        <DataArray type=\"Int32\" Name=\"types\" Format=\"ascii\">\n";
-    s += "          ";
-    for (uint i=0; i<m.nRealCells; ++i) {
-        bool isTriangle = m.cellsIsTriangle[i];
-        if (isTriangle) {
-            // Tri cell
-            s += "5  ";
-        } else {
-            // Quad cell
-            s += "9  ";
+    // Compact global node numbers, consecutive by writer rank then tag. The
+    //  numbers of the nodes written by other ranks are asked to their writer
+    std::vector<uint64_t> nodesId(m.nodesX.size(), 0);
+    for (uint k=0; k<nodes.size(); ++k) {
+        nodesId[nodes[k]] = before[2] + k;
+    }
+    std::vector<std::vector<uint64_t>> asked(pool.size);
+    std::vector<std::vector<uint>> askedNodes(pool.size);
+    for (uint n=0; n<m.nodesX.size(); ++n) {
+        if ((nodesWriter[n] >= 0) & (nodesWriter[n] != rank)) {
+            asked[nodesWriter[n]].push_back(nodesTag[n]);
+            askedNodes[nodesWriter[n]].push_back(n);
         }
     }
-    s += "\n";
-    s += "        </DataArray>\n";
-    s += "      </Cells>\n";
+    std::vector<int> askCounts(pool.size), askOffsets(pool.size, 0);
+    std::vector<int> answerCounts(pool.size), answerOffsets(pool.size, 0);
+    for (int r=0; r<pool.size; ++r) askCounts[r] = asked[r].size();
+    MPI_Alltoall(askCounts.data(), 1, MPI_INT, answerCounts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    for (int r=1; r<pool.size; ++r) {
+        askOffsets[r] = askOffsets[r-1] + askCounts[r-1];
+        answerOffsets[r] = answerOffsets[r-1] + answerCounts[r-1];
+    }
+    std::vector<uint64_t> askTags, answerTags(answerOffsets.back() + answerCounts.back());
+    for (auto& a : asked) askTags.insert(askTags.end(), a.begin(), a.end());
+    MPI_Alltoallv(
+        askTags.data(), askCounts.data(), askOffsets.data(), MPI_UINT64_T,
+        answerTags.data(), answerCounts.data(), answerOffsets.data(), MPI_UINT64_T, MPI_COMM_WORLD
+    );
+    for (auto& tag : answerTags) {
+        tag = nodesId[m.originalNodesRef.at(tag)];
+    }
+    MPI_Alltoallv(
+        answerTags.data(), answerCounts.data(), answerOffsets.data(), MPI_UINT64_T,
+        askTags.data(), askCounts.data(), askOffsets.data(), MPI_UINT64_T, MPI_COMM_WORLD
+    );
+    for (int r=0; r<pool.size; ++r) {
+        for (uint k=0; k<askedNodes[r].size(); ++k) {
+            nodesId[askedNodes[r][k]] = askTags[askOffsets[r] + k];
+        }
+    }
+
+    // Xml header and appended data layout, as in writeVtk
+    std::vector<uint64_t> blocks;
+    uint64_t offset = 0;
+    auto data_array = [&](
+        const std::string type, const std::string arrayName, const uint components, const uint64_t bytes
+    ) {
+        std::string s = "        <DataArray type=\"" + type + "\"";
+        if (arrayName != "") s += " Name=\"" + arrayName + "\"";
+        if (components > 1) s += " NumberOfComponents=\"" + std::to_string(components) + "\"";
+        s += " format=\"appended\" offset=\"" + std::to_string(offset) + "\"/>\n";
+        blocks.push_back(offset);
+        offset += sizeof(uint64_t) + bytes;
+        return s;
+    };
+    std::vector<uint64_t> blocksBytes = {
+        3*nPoints*real_size,
+        total[1]*sizeof(int32_t),
+        nCells*sizeof(int32_t),
+        nCells*sizeof(uint8_t),
+        nCells*sizeof(int32_t)
+    };
 
-    // Save scalar data
+    std::string s = "";
+    s += "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\"" + byte_order + "\" header_type=\"UInt64\">\n";
+    s += "  <UnstructuredGrid>\n";
+    s += "    <Piece NumberOfPoints=\"" + std::to_string(nPoints) + "\" NumberOfCells=\"" + std::to_string(nCells) + "\">\n";
+    s += "      <Points>\n";
+    s += data_array(real, "", 3, blocksBytes[0]);
+    s += "      </Points>\n";
+    s += "      <Cells>\n";
+    s += data_array("Int32", "connectivity", 1, blocksBytes[1]);
+    s += data_array("Int32", "offsets", 1, blocksBytes[2]);
+    s += data_array("UInt8", "types", 1, blocksBytes[3]);
+    s += "      </Cells>\n";
     s += "      <CellData Scalars=\"scalars\">\n";
+    s += data_array("Int32", "rank", 1, blocksBytes[4]);
+    for (auto varname : var_names) {
+        s += data_array(real, varname, 1, nCells*real_size);
+        blocksBytes.push_back(nCells*real_size);
+    }
+    for (auto& keyval : post::extra_scalars) {
+        s += data_array(real, keyval.first, 1, nCells*real_size);
+        blocksBytes.push_back(nCells*real_size);
+    }
+    for (auto& keyval : post::extra_vectors) {
+        s += data_array(real, keyval.first, 3, 3*nCells*real_size);
+        blocksBytes.push_back(3*nCells*real_size);
+    }
+    s += "      </CellData>\n";
+    s += "    </Piece>\n";
+    s += "  </UnstructuredGrid>\n";
+    s += "  <AppendedData encoding=\"raw\">\n_";
+    const std::string footer = "\n  </AppendedData>\n</VTKFile>\n";
+    const MPI_Offset start = s.size();
+
+    MPI_File fh;
+    if (MPI_File_open(MPI_COMM_WORLD, filename.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        throw std::invalid_argument("could not open output file " + filename);
+    }
+    MPI_File_set_size(fh, 0);
+
+    // Rank 0 writes the header, the byte count of each block and the footer
+    if (rank == 0) {
+        MPI_File_write_at(fh, 0, s.data(), s.size(), MPI_CHAR, MPI_STATUS_IGNORE);
+        for (uint b=0; b<blocks.size(); ++b) {
+            MPI_File_write_at(fh, start + blocks[b], &blocksBytes[b], 1, MPI_UINT64_T, MPI_STATUS_IGNORE);
+        }
+        MPI_File_write_at(fh, start + offset, footer.data(), footer.size(), MPI_CHAR, MPI_STATUS_IGNORE);
+    }
+
+    // Each array is one contiguous slab per rank, points included
+    std::vector<char> buffer;
+    buffer.reserve(3*real_size*nodes.size());
+    for (uint k=0; k<nodes.size(); ++k) {
+        pack_real(buffer, m.nodesX[nodes[k]], float64);
+        pack_real(buffer, m.nodesY[nodes[k]], float64);
+        pack_real(buffer, 0., float64);
+    }
+
+    auto write_slab = [&](const uint b, const uint64_t index, const uint64_t item_size) {
+        MPI_File_write_at_all(
+            fh, start + blocks[b] + sizeof(uint64_t) + index*item_size,
+            buffer.data(), buffer.size(), MPI_BYTE, MPI_STATUS_IGNORE
+        );
+        buffer.clear();
+    };
+
+    write_slab(0, before[2], 3*real_size);
+
+    for (auto i : cells) {
+        for (uint k=0; k<(m.cellsIsTriangle[i] ? 3 : 4); ++k) {
+            pack<int32_t>(buffer, nodesId[m.cellsNodes(i, k)]);
+        }
+    }
+    write_slab(1, before[1], sizeof(int32_t));
 
-    // Save cell rank
-    s += "        <DataArray type=\"Float32\" Name=\"rank\" Format=\"ascii\">\n";
-    for (int j=0; j<m.nRealCells; ++j) {
-        s += "          " + std::to_string(rank) + "\n";
+    int32_t current_offset = before[1];
+    for (auto i : cells) {
+        current_offset += m.cellsIsTriangle[i] ? 3 : 4;
+        pack<int32_t>(buffer, current_offset);
+    }
+    write_slab(2, before[0], sizeof(int32_t));
+
+    for (auto i : cells) {
+        pack<uint8_t>(buffer, m.cellsIsTriangle[i] ? 5 : 9);
     }
-    s += "        </DataArray>\n";
+    write_slab(3, before[0], sizeof(uint8_t));
 
-    // Save variables
-    for (uint i=0; i<var_names.size(); ++i) {
-        s += "        <DataArray type=\"Float32\" Name=\"" + var_names[i] + "\" Format=\"ascii\">\n";
-        for (int j=0; j<m.nRealCells; ++j) {
-            s += "          " + std::to_string(q[var_names.size()*j + i]) + "\n";
+    for (size_t k=0; k<cells.size(); ++k) {
+        pack<int32_t>(buffer, rank);
+    }
+    write_slab(4, before[0], sizeof(int32_t));
+
+    uint b = 5;
+    for (uint v=0; v<nvars; ++v) {
+        for (auto i : cells) {
+            pack_real(buffer, q[nvars*i + v], float64);
         }
-        s += "        </DataArray>\n";
+        write_slab(b++, before[0], real_size);
     }
     for (auto& keyval : post::extra_scalars) {
-        s += "        <DataArray type=\"Float32\" Name=\"" + keyval.first + "\" Format=\"ascii\">\n";
-        for (int j=0; j<m.nRealCells; ++j) {
+        for (auto i : cells) {
             double scal_i[1];
-            keyval.second(scal_i, &q[var_names.size()*j]);
-            s += "          " + std::to_string(scal_i[0]) + "\n";
+            keyval.second(scal_i, &q[nvars*i]);
+            pack_real(buffer, scal_i[0], float64);
+        }
+        write_slab(b++, before[0], real_size);
+    }
+    for (auto& keyval : post::extra_vectors) {
+        for (auto i : cells) {
+            double vec_i[2];
+            keyval.second(vec_i, &q[nvars*i]);
+            pack_real(buffer, vec_i[0], float64);
+            pack_real(buffer, vec_i[1], float64);
+            pack_real(buffer, 0., float64);
         }
-        s += "        </DataArray>\n";
+        write_slab(b++, before[0], 3*real_size);
     }
 
-    // Save vectors
-    if (post::extra_vectors.size() > 0) {
-        for (auto& keyval : post::extra_vectors) {
-            s += "        <DataArray type=\"Float32\" Name=\"" + keyval.first + "\" NumberOfComponents=\"3\" Format=\"ascii\">\n";
-            for (int j=0; j<m.nRealCells; ++j) {
-                double vec_i[2];
-                keyval.second(vec_i, &q[var_names.size()*j]);
-                s += "          " + std::to_string(vec_i[0]) + " ";
-                s += std::to_string(vec_i[1]) + " 0.0\n";
+    MPI_File_close(&fh);
+}
+
+
+
+
+static const char snapshot_magic[4] = {'F', 'V', 'H', 'Q'};
+
+
+post::output_stats write_snapshot(
+    const std::string filename,
+    std::vector<double>& q,
+    mesh& m,
+    const bool float64,
+    const post::compression& compression
+) {
+    auto begin = std::chrono::steady_clock::now();
+    const uint nvars = var_names.size();
+    const uint64_t nCells = m.nRealCells;
+    const uint32_t value_size = float64 ? sizeof(double) : sizeof(float);
+
+    post::binary_writer w(filename);
+    w.write(snapshot_magic, 4);
+    w.put<uint32_t>(1);
+    w.put<uint32_t>(nvars);
+    w.put<uint64_t>(nCells);
+    w.put<uint32_t>(value_size);
+
+    post::output_stats stats;
+    stats.raw_bytes = 24 + nvars*(16 + nCells*value_size);
+    stats.file_bytes = 24;
+
+    std::vector<char> values(nCells*value_size);
+    std::vector<char> shuffled(values.size());
+    std::vector<char> compressed(compressBound(values.size()));
+    for (uint v=0; v<nvars; ++v) {
+        auto it = compression.tolerances.find(var_names[v]);
+        const double tolerance = (it == compression.tolerances.end()) ? 0. : it->second;
+        for (uint j=0; j<nCells; ++j) {
+            const double qj = quantize(q[nvars*j + v], tolerance);
+            if (float64) {
+                std::memcpy(&values[j*value_size], &qj, value_size);
+            } else {
+                const float fj = qj;
+                std::memcpy(&values[j*value_size], &fj, value_size);
             }
-            s += "        </DataArray>\n";
         }
+        // Byte k of every value is stored in plane k
+        for (uint j=0; j<nCells; ++j) {
+            for (uint k=0; k<value_size; ++k) {
+                shuffled[k*nCells + j] = values[j*value_size + k];
+            }
+        }
+        uLongf compressed_size = compressed.size();
+        if (compress2(
+            (Bytef*) compressed.data(), &compressed_size,
+            (const Bytef*) shuffled.data(), shuffled.size(), compression.level
+        ) != Z_OK) {
+            throw std::invalid_argument("zlib compression failed");
+        }
+        w.put<double>(tolerance);
+        w.put<uint64_t>(compressed_size);
+        w.write(compressed.data(), compressed_size);
+        stats.file_bytes += 16 + compressed_size;
     }
+    w.close();
 
-    s += "      </CellData>\n";
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return stats;
+}
 
-    s += "    </Piece>\n";
-    s += "  </UnstructuredGrid>\n";
-    s += "</VTKFile>";
 
-    // Save data to file
-    std::ofstream out(filename);
-    out << s;
-    out.close();
+void read_snapshot(
+    const std::string filename,
+    std::vector<double>& q,
+    mesh& m
+) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+        throw std::invalid_argument("could not open snapshot file " + filename);
+    }
+    char magic[4];
+    uint32_t version, nvars, value_size;
+    uint64_t nCells;
+    in.read(magic, 4);
+    in.read((char*) &version, sizeof(version));
+    in.read((char*) &nvars, sizeof(nvars));
+    in.read((char*) &nCells, sizeof(nCells));
+    in.read((char*) &value_size, sizeof(value_size));
+    if (!in | (std::memcmp(magic, snapshot_magic, 4) != 0) | (version != 1)) {
+        throw std::invalid_argument("invalid snapshot file " + filename);
+    }
+    if ((nvars != var_names.size()) | (nCells != m.nRealCells)) {
+        throw std::invalid_argument("snapshot " + filename + " does not match the mesh and variables");
+    }
+    if (q.size() < nvars*m.cellsAreas.size()) {
+        q.resize(nvars*m.cellsAreas.size());
+    }
+
+    std::vector<char> shuffled(nCells*value_size);
+    std::vector<char> compressed;
+    for (uint v=0; v<nvars; ++v) {
+        double tolerance;
+        uint64_t compressed_size;
+        in.read((char*) &tolerance, sizeof(tolerance));
+        in.read((char*) &compressed_size, sizeof(compressed_size));
+        compressed.resize(compressed_size);
+        in.read(compressed.data(), compressed_size);
+        uLongf size = shuffled.size();
+        if (!in | (uncompress(
+            (Bytef*) shuffled.data(), &size, (const Bytef*) compressed.data(), compressed_size
+        ) != Z_OK) | (size != shuffled.size())) {
+            throw std::invalid_argument("corrupted snapshot file " + filename);
+        }
+        for (uint j=0; j<nCells; ++j) {
+            char value[sizeof(double)];
+            for (uint k=0; k<value_size; ++k) {
+                value[k] = shuffled[k*nCells + j];
+            }
+            if (value_size == sizeof(double)) {
+                std::memcpy(&q[nvars*j + v], value, sizeof(double));
+            } else {
+                float f;
+                std::memcpy(&f, value, sizeof(float));
+                q[nvars*j + v] = f;
+            }
+        }
+    }
+}
+
+
+
+
+static const char surface_magic[4] = {'F', 'V', 'H', 'S'};
+
+void writeSurface(
+    const std::string name,
+    std::vector<double>& q,
+    mesh& m,
+    mpi_wrapper& pool,
+    const std::vector<std::string>& boundaries,
+    const std::map<std::string, surface_quantity>& quantities,
+    const bool merged,
+    const bool binary
+) {
+    // Columns are the boundary index, center, normal and quantities
+    std::vector<std::string> columns = {"boundary", "x", "y", "nx", "ny"};
+    for (auto& keyval : quantities) {
+        columns.push_back(keyval.first);
+    }
+    const uint nColumns = columns.size();
+
+    std::vector<double> rows;
+    for (uint b=0; b<m.boundaryEdges.size(); ++b) {
+        const uint e = m.boundaryEdges[b];
+        const uint i = m.edgesCells(e, 0);
+        if (m.cellsIsGhost[i]) continue;
+        const std::string& bname = m.physicalNames.at(m.boundaryEdgesIntTag[b]);
+        auto it = std::find(boundaries.begin(), boundaries.end(), bname);
+        if (it == boundaries.end()) continue;
+
+        double n[2] = {m.edgesNormalsX[e], m.edgesNormalsY[e]};
+        const double d =
+            (m.edgesCentersX[e] - m.cellsCentersX[i])*n[0]
+            + (m.edgesCentersY[e] - m.cellsCentersY[i])*n[1];
+        rows.push_back(it - boundaries.begin());
+        rows.push_back(m.edgesCentersX[e]);
+        rows.push_back(m.edgesCentersY[e]);
+        rows.push_back(n[0]);
+        rows.push_back(n[1]);
+        for (auto& keyval : quantities) {
+            double f;
+            keyval.second(&f, &q[vars*i], n, d);
+            rows.push_back(f);
+        }
+    }
+
+    std::string filename = name;
+    if (merged & (pool.size > 1)) {
+        int count = rows.size();
+        std::vector<int> counts(pool.size);
+        std::vector<int> offsets(pool.size, 0);
+        MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+        for (uint r=1; r<pool.size; ++r) {
+            offsets[r] = offsets[r-1] + counts[r-1];
+        }
+        std::vector<double> all;
+        if (pool.rank == 0) {
+            all.resize(offsets.back() + counts.back());
+        }
+        MPI_Gatherv(
+            rows.data(), count, MPI_DOUBLE,
+            all.data(), counts.data(), offsets.data(), MPI_DOUBLE, 0, MPI_COMM_WORLD
+        );
+        if (pool.rank != 0) return;
+        rows.swap(all);
+    } else if (pool.size > 1) {
+        filename += "_" + std::to_string(pool.rank);
+    }
+    const uint64_t nRows = rows.size() / nColumns;
+
+    if (binary) {
+        // Header, nul terminated column and boundary names, then the rows
+        post::binary_writer w(filename + ".bin");
+        w.write(surface_magic, 4);
+        w.put<uint32_t>(1);
+        w.put<uint32_t>(nColumns);
+        w.put<uint32_t>(boundaries.size());
+        w.put<uint64_t>(nRows);
+        for (auto& c : columns) {
+            w.write(c + '\0');
+        }
+        for (auto& b : boundaries) {
+            w.write(b + '\0');
+        }
+        w.write(rows.data(), rows.size()*sizeof(double));
+        w.close();
+    } else {
+        std::ofstream out(filename + ".csv");
+        if (!out) {
+            throw std::invalid_argument("could not open output file " + filename + ".csv");
+        }
+        out << std::setprecision(10);
+        for (uint k=0; k<nColumns; ++k) {
+            out << (k ? "," : "") << columns[k];
+        }
+        out << "\n";
+        for (uint64_t r=0; r<nRows; ++r) {
+            out << boundaries[rows[nColumns*r]];
+            for (uint k=1; k<nColumns; ++k) {
+                out << "," << rows[nColumns*r + k];
+            }
+            out << "\n";
+        }
+    }
+}
+
+
+
+std::string time_series_writer::piece_name(const int r) const {
+    return (world_size > 1) ? name + "_" + std::to_string(r) : name;
+}
+
+
+static const std::string xmf_footer = "    </Grid>\n  </Domain>\n</Xdmf>\n";
+
+
+void time_series_writer::start(
+    const std::string name_,
+    mesh& m_,
+    mpi_wrapper& pool,
+    const bool float64_
+) {
+    name = name_;
+    m = &m_;
+    rank = pool.rank;
+    world_size = pool.size;
+    float64 = float64_;
+
+    // Mixed topology, each cell is its xdmf type followed by its nodes
+    uint64_t nTopology = 0;
+    for (uint i=0; i<m->nRealCells; ++i) {
+        nTopology += m->cellsIsTriangle[i] ? 4 : 5;
+    }
+    uint64_t sizes[3] = {m->nodesX.size(), m->nRealCells, nTopology};
+    std::vector<uint64_t> allSizes(3*world_size);
+    MPI_Gather(sizes, 3, MPI_UINT64_T, allSizes.data(), 3, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        piecesPoints.resize(world_size);
+        piecesCells.resize(world_size);
+        piecesTopology.resize(world_size);
+        for (uint r=0; r<world_size; ++r) {
+            piecesPoints[r] = allSizes[3*r];
+            piecesCells[r] = allSizes[3*r + 1];
+            piecesTopology[r] = allSizes[3*r + 2];
+        }
+    }
+
+    std::filesystem::create_directories("times");
+    post::binary_writer w("times/" + piece_name(rank) + "_geometry.bin");
+    for (uint i=0; i<m->nodesX.size(); ++i) {
+        w.put(m->nodesX[i]);
+        w.put(m->nodesY[i]);
+    }
+    for (uint i=0; i<m->nRealCells; ++i) {
+        // Triangle 4, quadrilateral 5
+        const bool isTriangle = m->cellsIsTriangle[i];
+        w.put<int32_t>(isTriangle ? 4 : 5);
+        for (uint k=0; k<(isTriangle ? 3 : 4); ++k) {
+            w.put<int32_t>(m->cellsNodes(i, k));
+        }
+    }
+    for (uint i=0; i<m->nRealCells; ++i) {
+        w.put<int32_t>(rank);
+    }
+    w.close();
+
+    if (rank == 0) {
+        xmf.open(name + ".xmf", std::ios::out | std::ios::trunc);
+        if (!xmf) {
+            throw std::invalid_argument("could not open output file " + name + ".xmf");
+        }
+        xmf << "<?xml version=\"1.0\" ?>\n";
+        xmf << "<Xdmf Version=\"3.0\">\n";
+        xmf << "  <Domain>\n";
+        xmf << "    <Grid Name=\"" << name << "\" GridType=\"Collection\" CollectionType=\"Temporal\">\n";
+        xmf_end = xmf.tellp();
+        xmf << xmf_footer;
+        xmf.flush();
+    }
+}
+
+
+std::string time_series_writer::snapshot_grid(
+    const std::string time_name,
+    const double time
+) const {
+    const std::string endian = post::little_endian() ? "Little" : "Big";
+    const uint real_size = float64 ? sizeof(double) : sizeof(float);
+
+    std::ostringstream time_value;
+    time_value << std::setprecision(15) << time;
+
+    auto data_item = [&](
+        const std::string dims, const std::string type, const uint precision,
+        const std::string file, const uint64_t seek
+    ) {
+        return "<DataItem Dimensions=\"" + dims + "\" NumberType=\"" + type
+            + "\" Precision=\"" + std::to_string(precision)
+            + "\" Format=\"Binary\" Endian=\"" + endian
+            + "\" Seek=\"" + std::to_string(seek) + "\">" + file + "</DataItem>";
+    };
+
+    const std::string pad = (world_size > 1) ? "        " : "      ";
+    std::string s = "";
+    if (world_size > 1) {
+        s += "      <Grid Name=\"" + time_name + "\" GridType=\"Collection\" CollectionType=\"Spatial\">\n";
+        s += "        <Time Value=\"" + time_value.str() + "\"/>\n";
+    }
+    for (uint r=0; r<world_size; ++r) {
+        const std::string np = std::to_string(piecesPoints[r]);
+        const std::string nc = std::to_string(piecesCells[r]);
+        const std::string geometry = "times/" + piece_name(r) + "_geometry.bin";
+        const std::string fields = "times/" + piece_name(r) + "_" + time_name + ".bin";
+
+        s += pad + "<Grid Name=\"" + ((world_size > 1) ? piece_name(r) : time_name) + "\" GridType=\"Uniform\">\n";
+        if (world_size == 1) {
+            s += pad + "  <Time Value=\"" + time_value.str() + "\"/>\n";
+        }
+        s += pad + "  <Topology TopologyType=\"Mixed\" NumberOfElements=\"" + nc + "\">\n";
+        s += pad + "    " + data_item(std::to_string(piecesTopology[r]), "Int", 4, geometry, 16*piecesPoints[r]) + "\n";
+        s += pad + "  </Topology>\n";
+        s += pad + "  <Geometry GeometryType=\"XY\">\n";
+        s += pad + "    " + data_item(np + " 2", "Float", 8, geometry, 0) + "\n";
+        s += pad + "  </Geometry>\n";
+        s += pad + "  <Attribute Name=\"rank\" AttributeType=\"Scalar\" Center=\"Cell\">\n";
+        s += pad + "    " + data_item(nc, "Int", 4, geometry, 16*piecesPoints[r] + 4*piecesTopology[r]) + "\n";
+        s += pad + "  </Attribute>\n";
+
+        // Fields are stored back to back in the order of write_cell_fields
+        uint64_t seek = 0;
+        auto attribute = [&](const std::string attrName, const bool vector) {
+            s += pad + "  <Attribute Name=\"" + attrName + "\" AttributeType=\""
+                + (vector ? "Vector" : "Scalar") + "\" Center=\"Cell\">\n";
+            s += pad + "    " + data_item(vector ? nc + " 3" : nc, "Float", real_size, fields, seek) + "\n";
+            s += pad + "  </Attribute>\n";
+            seek += (vector ? 3 : 1)*piecesCells[r]*real_size;
+        };
+        for (auto varname : var_names) {
+            attribute(varname, false);
+        }
+        for (auto& keyval : post::extra_scalars) {
+            attribute(keyval.first, false);
+        }
+        for (auto& keyval : post::extra_vectors) {
+            attribute(keyval.first, true);
+        }
+        s += pad + "</Grid>\n";
+    }
+    if (world_size > 1) {
+        s += "      </Grid>\n";
+    }
+    return s;
+}
+
 
+void time_series_writer::write(
+    std::vector<double>& q,
+    const std::string time_name,
+    const double time
+) {
+    post::binary_writer w("times/" + piece_name(rank) + "_" + time_name + ".bin");
+    write_cell_fields(w, q, *m, float64);
+    w.close();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    writtenNames.push_back(time_name);
+    writtenTimes.push_back(time);
+}
+
+
+void time_series_writer::append(const uint64_t count) {
+    if (rank != 0) {
+        published = std::max(published, count);
+        return;
+    }
+    if (count <= published) return;
+    // Overwrite the closing tags with the new snapshots
+    xmf.seekp(xmf_end);
+    for (uint64_t n=published; n<count; ++n) {
+        std::string time_name;
+        double time;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            time_name = writtenNames[n];
+            time = writtenTimes[n];
+        }
+        xmf << snapshot_grid(time_name, time);
+    }
+    xmf_end = xmf.tellp();
+    xmf << xmf_footer;
+    xmf.flush();
+    published = count;
+}
+
+
+void time_series_writer::publish() {
+    // Reductions complete in the order they were posted
+    while (!reductions.empty()) {
+        int done = 0;
+        MPI_Test(&reductions.front().request, &done, MPI_STATUS_IGNORE);
+        if (!done) break;
+        append(reductions.front().min);
+        reductions.pop_front();
+    }
+    reductions.emplace_back();
+    count_reduction& r = reductions.back();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        r.local = writtenNames.size();
+    }
+    MPI_Iallreduce(&r.local, &r.min, 1, MPI_UINT64_T, MPI_MIN, MPI_COMM_WORLD, &r.request);
+}
+
+
+void time_series_writer::finish() {
+    for (auto& r : reductions) {
+        MPI_Wait(&r.request, MPI_STATUS_IGNORE);
+        append(r.min);
+    }
+    reductions.clear();
+    uint64_t local = writtenNames.size();
+    uint64_t count;
+    MPI_Allreduce(&local, &count, 1, MPI_UINT64_T, MPI_MIN, MPI_COMM_WORLD);
+    append(count);
+}
+
+
+
+
+void async_writer::start(
+    std::function<void(std::vector<double>&, const std::string, const double)> output_
+) {
+    output = output_;
+    stop = false;
+    thread = std::thread(&async_writer::run, this);
+}
+
+
+void async_writer::write(
+    const std::vector<double>& q,
+    const std::string time_name,
+    const double time
+) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (error) std::rethrow_exception(error);
+        if (full[next]) {
+            // Backpressure, wait for the writer thread to free the buffer
+            auto begin = std::chrono::steady_clock::now();
+            cv.wait(lock, [&]{ return !full[next] | bool(error); });
+            stall_seconds += std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - begin
+            ).count();
+            stalls += 1;
+            if (error) std::rethrow_exception(error);
+        }
+    }
+    // The writer thread never reads a buffer that is not full
+    staging[next] = q;
+    times[next] = time_name;
+    stamps[next] = time;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        full[next] = true;
+        next = 1 - next;
+    }
+    cv.notify_all();
+}
+
+
+void async_writer::run() {
+    uint current = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]{ return full[current] | stop; });
+            if (!full[current]) return;
+        }
+        try {
+            output(staging[current], times[current], stamps[current]);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = std::current_exception();
+            full = {false, false};
+            cv.notify_all();
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            full[current] = false;
+        }
+        cv.notify_all();
+        current = 1 - current;
+    }
+}
+
+
+void async_writer::finish() {
+    if (thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cv.notify_all();
+        // Pending snapshots are written before the thread exits
+        thread.join();
+    }
+    if (error) {
+        std::exception_ptr e = error;
+        error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+
+async_writer::~async_writer() {
+    if (thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cv.notify_all();
+        thread.join();
+    }
 }
 
 
@@ -0,0 +1,155 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Spatial search sources
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#include <fvhyper/search.h>
+#include <algorithm>
+#include <cmath>
+
+
+namespace fvhyper {
+
+
+void cell_locator::build(mesh& m_, const double cells_per_bin) {
+    m = &m_;
+
+    // Owned cells only, so that each point is found on one rank
+    std::vector<uint> cells;
+    xmin = 1e300;
+    ymin = 1e300;
+    double xmax = -1e300;
+    double ymax = -1e300;
+    for (uint i=0; i<m->nRealCells; ++i) {
+        if (m->cellsIsGhost[i]) continue;
+        cells.push_back(i);
+        for (uint k=0; k<(m->cellsIsTriangle[i] ? 3 : 4); ++k) {
+            const uint n = m->cellsNodes(i, k);
+            xmin = std::min(xmin, m->nodesX[n]);
+            xmax = std::max(xmax, m->nodesX[n]);
+            ymin = std::min(ymin, m->nodesY[n]);
+            ymax = std::max(ymax, m->nodesY[n]);
+        }
+    }
+    if (cells.size() == 0) {
+        nx = 0;
+        ny = 0;
+        binsStart.assign(1, 0);
+        binsCells.clear();
+        return;
+    }
+
+    // Square bins sized for the requested density
+    const double lx = std::max(xmax - xmin, 1e-300);
+    const double ly = std::max(ymax - ymin, 1e-300);
+    const double nbins = std::max(1., cells.size()/cells_per_bin);
+    const double h = std::sqrt(lx*ly/nbins);
+    nx = std::max(1u, std::min(4096u, (uint) std::ceil(lx/h)));
+    ny = std::max(1u, std::min(4096u, (uint) std::ceil(ly/h)));
+    dx = lx/nx;
+    dy = ly/ny;
+
+    // Cell bounding box to bin ranges
+    auto bin_range = [&](const uint i, uint* r) {
+        double x0 = 1e300, x1 = -1e300, y0 = 1e300, y1 = -1e300;
+        for (uint k=0; k<(m->cellsIsTriangle[i] ? 3 : 4); ++k) {
+            const uint n = m->cellsNodes(i, k);
+            x0 = std::min(x0, m->nodesX[n]);
+            x1 = std::max(x1, m->nodesX[n]);
+            y0 = std::min(y0, m->nodesY[n]);
+            y1 = std::max(y1, m->nodesY[n]);
+        }
+        r[0] = std::min(nx - 1, (uint) std::max(0., (x0 - xmin)/dx));
+        r[1] = std::min(nx - 1, (uint) std::max(0., (x1 - xmin)/dx));
+        r[2] = std::min(ny - 1, (uint) std::max(0., (y0 - ymin)/dy));
+        r[3] = std::min(ny - 1, (uint) std::max(0., (y1 - ymin)/dy));
+    };
+
+    binsStart.assign(nx*ny + 1, 0);
+    uint r[4];
+    for (auto i : cells) {
+        bin_range(i, r);
+        for (uint by=r[2]; by<=r[3]; ++by) {
+            for (uint bx=r[0]; bx<=r[1]; ++bx) {
+                binsStart[by*nx + bx + 1] += 1;
+            }
+        }
+    }
+    for (uint b=0; b<nx*ny; ++b) {
+        binsStart[b+1] += binsStart[b];
+    }
+    binsCells.resize(binsStart[nx*ny]);
+    std::vector<uint> fill(binsStart.begin(), binsStart.end() - 1);
+    for (auto i : cells) {
+        bin_range(i, r);
+        for (uint by=r[2]; by<=r[3]; ++by) {
+            for (uint bx=r[0]; bx<=r[1]; ++bx) {
+                binsCells[fill[by*nx + bx]++] = i;
+            }
+        }
+    }
+}
+
+
+bool cell_locator::cell_contains(const uint i, const double x, const double y) const {
+    // Crossing number test, points on an edge count as inside
+    const uint size = m->cellsIsTriangle[i] ? 3 : 4;
+    bool inside = false;
+    for (uint k=0; k<size; ++k) {
+        const uint a = m->cellsNodes(i, k);
+        const uint b = m->cellsNodes(i, (k + 1) % size);
+        const double xa = m->nodesX[a], ya = m->nodesY[a];
+        const double xb = m->nodesX[b], yb = m->nodesY[b];
+        const double cross = (xb - xa)*(y - ya) - (yb - ya)*(x - xa);
+        const double scale = std::abs(xb - xa) + std::abs(yb - ya);
+        if ((std::abs(cross) <= 1e-12*scale*scale)
+            & (x >= std::min(xa, xb) - 1e-12*scale) & (x <= std::max(xa, xb) + 1e-12*scale)
+            & (y >= std::min(ya, yb) - 1e-12*scale) & (y <= std::max(ya, yb) + 1e-12*scale)) {
+            return true;
+        }
+        if ((ya > y) != (yb > y)) {
+            const double xc = xa + (y - ya)*(xb - xa)/(yb - ya);
+            if (x < xc) inside = !inside;
+        }
+    }
+    return inside;
+}
+
+
+int cell_locator::locate(const double x, const double y) const {
+    if ((nx == 0) | (x < xmin) | (y < ymin)) return -1;
+    const uint bx = (uint) ((x - xmin)/dx);
+    const uint by = (uint) ((y - ymin)/dy);
+    // Points on the far bounds belong to the last bin
+    if ((bx > nx) | (by > ny)) return -1;
+    const uint b = std::min(by, ny - 1)*nx + std::min(bx, nx - 1);
+    for (uint k=binsStart[b]; k<binsStart[b+1]; ++k) {
+        if (cell_contains(binsCells[k], x, y)) return binsCells[k];
+    }
+    return -1;
+}
+
+
+void cell_locator::locate(
+    std::vector<int>& cells,
+    const std::vector<double>& x,
+    const std::vector<double>& y
+) const {
+    cells.resize(x.size());
+    for (uint p=0; p<x.size(); ++p) {
+        cells[p] = locate(x[p], y[p]);
+    }
+}
+
+
+}
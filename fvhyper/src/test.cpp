@@ -15,6 +15,11 @@
 */
 #include <fvhyper/test.h>
 #include <fvhyper/parallel.h>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
 
 
 
@@ -61,6 +66,188 @@ void tester::operator()() {
 
 
 
+
+
+
+// Minimal reader of the baseline json, objects of numbers and objects only
+static void skip_spaces(const std::string& s, size_t& i) {
+    while ((i < s.size()) && isspace(s[i])) i += 1;
+}
+
+static void expect(const std::string& s, size_t& i, const char c) {
+    skip_spaces(s, i);
+    if ((i >= s.size()) || (s[i] != c)) {
+        throw std::invalid_argument("expected '" + std::string(1, c) + "' at character " + std::to_string(i) + " of baseline");
+    }
+    i += 1;
+}
+
+static std::string read_key(const std::string& s, size_t& i) {
+    expect(s, i, '"');
+    const size_t end = s.find('"', i);
+    if (end == std::string::npos) throw std::invalid_argument("unterminated string in baseline");
+    std::string key = s.substr(i, end - i);
+    i = end + 1;
+    return key;
+}
+
+static void read_object(
+    const std::string& s,
+    size_t& i,
+    const std::string prefix,
+    std::map<std::string, double>& values
+) {
+    // Nested keys are flattened as "outer/inner"
+    expect(s, i, '{');
+    skip_spaces(s, i);
+    if ((i < s.size()) && (s[i] == '}')) {
+        i += 1;
+        return;
+    }
+    while (true) {
+        const std::string key = prefix + read_key(s, i);
+        expect(s, i, ':');
+        skip_spaces(s, i);
+        if ((i < s.size()) && (s[i] == '{')) {
+            read_object(s, i, key + "/", values);
+        } else {
+            size_t used = 0;
+            values[key] = std::stod(s.substr(i, 32), &used);
+            i += used;
+        }
+        skip_spaces(s, i);
+        if ((i < s.size()) && (s[i] == ',')) {
+            i += 1;
+        } else {
+            expect(s, i, '}');
+            return;
+        }
+    }
+}
+
+
+void perf_baseline::read(const std::string filename) {
+    std::ifstream file(filename);
+    if (!file.good()) {
+        throw std::invalid_argument("can not read baseline file " + filename);
+    }
+    std::stringstream ss;
+    ss << file.rdbuf();
+    const std::string s = ss.str();
+
+    std::map<std::string, double> values;
+    size_t i = 0;
+    read_object(s, i, "", values);
+
+    metrics.clear();
+    tolerances.clear();
+    for (auto& keyval : values) {
+        const std::string& key = keyval.first;
+        if (key == "ranks") {
+            ranks = keyval.second;
+        } else if (key == "tolerance") {
+            tolerance = keyval.second;
+        } else if (key.rfind("metrics/", 0) == 0) {
+            metrics[key.substr(8)] = keyval.second;
+        } else if (key.rfind("tolerances/", 0) == 0) {
+            tolerances[key.substr(11)] = keyval.second;
+        }
+    }
+}
+
+
+void perf_baseline::write(const std::string filename) const {
+    std::ofstream file(filename);
+    file << std::setprecision(6);
+    file << "{\n";
+    file << "    \"ranks\": " << ranks << ",\n";
+    file << "    \"tolerance\": " << tolerance << ",\n";
+    file << "    \"metrics\": {";
+    uint k = 0;
+    for (auto& keyval : metrics) {
+        file << ((k++ == 0) ? "\n" : ",\n");
+        file << "        \"" << keyval.first << "\": " << keyval.second;
+    }
+    file << "\n    },\n";
+    file << "    \"tolerances\": {";
+    k = 0;
+    for (auto& keyval : tolerances) {
+        file << ((k++ == 0) ? "\n" : ",\n");
+        file << "        \"" << keyval.first << "\": " << keyval.second;
+    }
+    file << ((k == 0) ? "}\n" : "\n    }\n");
+    file << "}\n";
+}
+
+
+
+perf_tester::perf_tester(
+    std::string name_in,
+    std::vector<metric> (*to_measure_in)(mpi_wrapper&),
+    mpi_wrapper& pool_in,
+    perf_baseline& baseline_in,
+    const bool update_in
+) {
+    name = name_in;
+    to_measure = to_measure_in;
+    pool = &pool_in;
+    baseline = &baseline_in;
+    update = update_in;
+}
+
+void perf_tester::operator()() {
+    auto measured = to_measure(*pool);
+
+    // Every rank measures the same metrics
+    const uint n = measured.size();
+    std::vector<double> local(n);
+    std::vector<double> all(n*pool->size);
+    for (uint i=0; i<n; ++i) local[i] = measured[i].value;
+    MPI_Gather(local.data(), n, MPI_DOUBLE, all.data(), n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    if (pool->rank == 0) {
+        for (uint i=0; i<n; ++i) {
+            const std::string key = name + "." + measured[i].name;
+
+            if (update) {
+                double mean = 0.;
+                for (uint r=0; r<pool->size; ++r) mean += all[n*r + i]/pool->size;
+                baseline->metrics[key] = mean;
+                std::cout << "Perf " << key << " baseline set to " << mean << std::endl;
+                continue;
+            }
+
+            std::cout << "Perf " << key << " (";
+            if (baseline->metrics.find(key) == baseline->metrics.end()) {
+                std::cout << "\033[1;31mno baseline\033[0m)" << std::endl;
+                failures += 1;
+                continue;
+            }
+            const double base = baseline->metrics.at(key);
+            const double tol = (baseline->tolerances.find(key) != baseline->tolerances.end()) ?
+                baseline->tolerances.at(key) : baseline->tolerance;
+
+            for (uint r=0; r<pool->size; ++r) {
+                const double change = (base != 0.) ? all[n*r + i]/base - 1. : all[n*r + i];
+                const bool pass = measured[i].higher_is_better ?
+                    (change >= -tol) : (change <= tol);
+                if (r != 0) std::cout << ", ";
+                char pct[32];
+                snprintf(pct, sizeof(pct), "%+.1f%%", 100.*change);
+                std::cout << std::to_string(r) + ": ";
+                if (pass) {
+                    std::cout << "\033[1;32msuccess " << pct << "\033[0m";
+                } else {
+                    std::cout << "\033[1;31mfailure " << pct << "\033[0m";
+                    failures += 1;
+                }
+            }
+            std::cout << ") baseline " << base << std::endl;
+        }
+    }
+    MPI_Bcast(&failures, 1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+}
+
 }
 
 
@@ -0,0 +1,266 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Phase timers source
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#include <fvhyper/timers.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+
+namespace fvhyper {
+
+
+namespace timers {
+
+    const char* phase_names[n_phases] = {
+        "step",
+        "calc_dt",
+        "calc_gradients",
+        "calc_limiters",
+        "calc_time_derivatives",
+        "update_bounds",
+        "update_comms",
+        "smooth_residuals",
+        "implicit_smoothing",
+        "calc_residuals",
+        "output",
+        "monitors",
+        "checkpoint",
+        "mpi_send",
+        "mpi_recv",
+        "mpi_barrier"
+    };
+
+    phase_totals totals[n_phases];
+    event_tracer tracer;
+
+    void reset() {
+        for (uint p=0; p<n_phases; ++p) {
+            totals[p] = phase_totals();
+        }
+    }
+
+    void report(mpi_wrapper& pool, const bool print, const std::string json_file) {
+        double seconds[n_phases];
+        double counts[2*n_phases];
+        for (uint p=0; p<n_phases; ++p) {
+            seconds[p] = totals[p].seconds;
+            counts[2*p] = totals[p].calls;
+            counts[2*p + 1] = totals[p].bytes;
+        }
+        double tmin[n_phases], tmax[n_phases], tsum[n_phases], csum[2*n_phases];
+        MPI_Reduce(seconds, tmin, n_phases, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+        MPI_Reduce(seconds, tmax, n_phases, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        MPI_Reduce(seconds, tsum, n_phases, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+        MPI_Reduce(counts, csum, 2*n_phases, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (pool.rank != 0) return;
+
+        const double total = std::max(tmax[step], 1e-300);
+        if (print) {
+            std::cout << std::left << std::setw(24) << "Phase" << std::right;
+            std::cout << std::setw(12) << "Calls/rank" << std::setw(12) << "Min (s)";
+            std::cout << std::setw(12) << "Avg (s)" << std::setw(12) << "Max (s)";
+            std::cout << std::setw(10) << "Max %" << std::setw(14) << "MB/rank" << "\n";
+            for (uint p=0; p<n_phases; ++p) {
+                if (csum[2*p] == 0.) continue;
+                std::cout << std::left << std::setw(24) << phase_names[p] << std::right;
+                std::cout << std::setw(12) << (uint64_t) (csum[2*p]/pool.size);
+                std::cout << std::fixed << std::setprecision(4);
+                std::cout << std::setw(12) << tmin[p] << std::setw(12) << tsum[p]/pool.size;
+                std::cout << std::setw(12) << tmax[p];
+                std::cout << std::setprecision(1) << std::setw(10) << 100.*tmax[p]/total;
+                std::cout << std::setprecision(3) << std::setw(14) << csum[2*p + 1]/pool.size/1e6;
+                std::cout << std::defaultfloat << "\n";
+            }
+            std::cout << std::flush;
+        }
+
+        if (json_file != "") {
+            std::ofstream out(json_file);
+            if (!out) {
+                throw std::invalid_argument("could not open timers file " + json_file);
+            }
+            out << std::setprecision(9);
+            // Calls and bytes are per rank, times in seconds
+            out << "{\n  \"ranks\": " << pool.size << ",\n  \"phases\": {\n";
+            bool first = true;
+            for (uint p=0; p<n_phases; ++p) {
+                if (csum[2*p] == 0.) continue;
+                out << (first ? "" : ",\n");
+                out << "    \"" << phase_names[p] << "\": {";
+                out << "\"calls\": " << (uint64_t) (csum[2*p]/pool.size);
+                out << ", \"min\": " << tmin[p];
+                out << ", \"avg\": " << tsum[p]/pool.size;
+                out << ", \"max\": " << tmax[p];
+                out << ", \"bytes\": " << (uint64_t) (csum[2*p + 1]/pool.size) << "}";
+                first = false;
+            }
+            out << "\n  }\n}\n";
+        }
+    }
+
+    void report_counters(mpi_wrapper& pool, const uint64_t edges, const bool print, const std::string json_file) {
+        // Counts, then calls times edges, summed over the ranks
+        const uint n = counters::n_events;
+        std::vector<double> local((n + 1)*n_phases), sum((n + 1)*n_phases);
+        for (uint p=0; p<n_phases; ++p) {
+            for (uint e=0; e<n; ++e) local[(n + 1)*p + e] = totals[p].events[e];
+            local[(n + 1)*p + n] = (double) totals[p].calls*edges;
+        }
+        int counted[counters::n_events], allCounted[counters::n_events];
+        for (uint e=0; e<n; ++e) counted[e] = counters::counted((counters::event) e);
+        MPI_Reduce(local.data(), sum.data(), local.size(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+        MPI_Reduce(counted, allCounted, n, MPI_INT, MPI_MIN, 0, MPI_COMM_WORLD);
+        if (pool.rank != 0) return;
+
+        // Ratio of two sums, -1 when an event is missing on some rank
+        auto ratio = [&](const uint p, const int e, const int d) {
+            if (!allCounted[e] | ((d < (int) n) && !allCounted[d])) return -1.;
+            const double den = sum[(n + 1)*p + d];
+            return (den > 0.) ? sum[(n + 1)*p + e]/den : 0.;
+        };
+        auto cell = [](const double v, const int width, const int precision) {
+            std::ostringstream s;
+            if (v < 0.) s << "-";
+            else s << std::fixed << std::setprecision(precision) << v;
+            std::cout << std::setw(width) << s.str();
+        };
+        using namespace counters;
+
+        if (print) {
+            std::cout << std::left << std::setw(24) << "Phase" << std::right;
+            std::cout << std::setw(14) << "Mcycles/rank" << std::setw(8) << "IPC";
+            std::cout << std::setw(14) << "Cycles/edge" << std::setw(14) << "LLC mis/edge";
+            std::cout << std::setw(14) << "Br mis/edge" << "\n";
+            for (uint p=0; p<n_phases; ++p) {
+                if (totals[p].calls == 0) continue;
+                std::cout << std::left << std::setw(24) << phase_names[p] << std::right;
+                cell(allCounted[cycles] ? sum[(n + 1)*p + cycles]/pool.size/1e6 : -1., 14, 2);
+                cell(ratio(p, instructions, cycles), 8, 2);
+                cell(ratio(p, cycles, n), 14, 2);
+                cell(ratio(p, llc_misses, n), 14, 4);
+                cell(ratio(p, branch_misses, n), 14, 4);
+                std::cout << "\n";
+            }
+            std::cout << std::flush;
+        }
+
+        if (json_file != "") {
+            std::ofstream out(json_file);
+            if (!out) {
+                throw std::invalid_argument("could not open counters file " + json_file);
+            }
+            out << std::setprecision(9);
+            // Counts are per rank, per edge values divide by the edges of every call
+            out << "{\n  \"ranks\": " << pool.size << ",\n  \"phases\": {\n";
+            bool first = true;
+            for (uint p=0; p<n_phases; ++p) {
+                if (totals[p].calls == 0) continue;
+                out << (first ? "" : ",\n");
+                out << "    \"" << phase_names[p] << "\": {";
+                bool firstEvent = true;
+                for (uint e=0; e<n; ++e) {
+                    if (!allCounted[e]) continue;
+                    out << (firstEvent ? "" : ", ");
+                    out << "\"" << event_names[e] << "\": " << (uint64_t) (sum[(n + 1)*p + e]/pool.size);
+                    out << ", \"" << event_names[e] << "_per_edge\": " << ratio(p, e, n);
+                    firstEvent = false;
+                }
+                if (allCounted[instructions] & allCounted[cycles]) {
+                    out << ", \"ipc\": " << ratio(p, instructions, cycles);
+                }
+                out << "}";
+                first = false;
+            }
+            out << "\n  }\n}\n";
+        }
+    }
+
+    void start_trace(const uint capacity) {
+        tracer.events.assign(capacity, trace_event());
+        tracer.recorded = 0;
+        MPI_Barrier(MPI_COMM_WORLD);
+        tracer.origin = std::chrono::steady_clock::now();
+    }
+
+
+    void write_trace(const std::string filename, mpi_wrapper& pool) {
+        // Events of this rank in time order, as begin, duration in us, phase, peer, bytes
+        const uint64_t capacity = tracer.events.size();
+        const uint64_t count = std::min(tracer.recorded, capacity);
+        const uint64_t first = tracer.recorded - count;
+        std::vector<double> local(5*count);
+        for (uint64_t k=0; k<count; ++k) {
+            const trace_event& e = tracer.events[(first + k) % capacity];
+            local[5*k] = std::chrono::duration<double, std::micro>(e.begin - tracer.origin).count();
+            local[5*k + 1] = std::chrono::duration<double, std::micro>(e.end - e.begin).count();
+            local[5*k + 2] = e.p;
+            local[5*k + 3] = e.peer;
+            local[5*k + 4] = e.bytes;
+        }
+        uint64_t dropped = first;
+        tracer.events.clear();
+        tracer.events.shrink_to_fit();
+
+        int size = local.size();
+        std::vector<int> sizes(pool.size);
+        std::vector<int> offsets(pool.size, 0);
+        std::vector<uint64_t> allDropped(pool.size);
+        MPI_Gather(&size, 1, MPI_INT, sizes.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+        MPI_Gather(&dropped, 1, MPI_UINT64_T, allDropped.data(), 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+        for (int r=1; r<pool.size; ++r) {
+            offsets[r] = offsets[r-1] + sizes[r-1];
+        }
+        std::vector<double> all;
+        if (pool.rank == 0) all.resize(offsets.back() + sizes.back());
+        MPI_Gatherv(
+            local.data(), size, MPI_DOUBLE, all.data(), sizes.data(), offsets.data(), MPI_DOUBLE, 0, MPI_COMM_WORLD
+        );
+        if (pool.rank != 0) return;
+
+        std::ofstream out(filename);
+        if (!out) {
+            throw std::invalid_argument("could not open trace file " + filename);
+        }
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        for (int r=0; r<pool.size; ++r) {
+            out << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << r;
+            out << ", \"args\": {\"name\": \"rank " << r << "\", \"dropped_events\": " << allDropped[r] << "}},\n";
+        }
+        for (int r=0; r<pool.size; ++r) {
+            for (int k=offsets[r]; k<offsets[r] + sizes[r]; k+=5) {
+                const uint p = all[k + 2];
+                out << "{\"name\": \"" << phase_names[p] << "\", \"ph\": \"X\", \"pid\": " << r;
+                out << ", \"tid\": 0, \"ts\": " << all[k] << ", \"dur\": " << all[k + 1];
+                if (all[k + 3] >= 0) {
+                    out << ", \"args\": {\"peer\": " << (int) all[k + 3];
+                    out << ", \"bytes\": " << (uint64_t) all[k + 4] << "}";
+                }
+                out << "},\n";
+            }
+        }
+        // Closing metadata event, so every event line ends with a comma
+        out << "{\"name\": \"trace_end\", \"ph\": \"M\", \"pid\": 0}\n]}\n";
+    }
+}
+
+
+
+}
@@ -16,6 +16,9 @@
 #pragma once
 
 #include <iostream>
+#include <map>
+#include <string>
+#include <vector>
 #include <fvhyper/parallel.h>
 
 
@@ -45,5 +48,65 @@ public:
 
 
 
+/*
+    Performance regression checks
+    A perf test measures named metrics on every rank, each compared with
+    the baseline value of "test.metric" within a relative tolerance, and
+    reported per rank like a tester. Baselines are json files:
+        {
+            "ranks": 1,
+            "tolerance": 0.25,
+            "metrics": {"kernels.calc_gradients": 1.2e7, ...},
+            "tolerances": {"solve.steps": 0}
+        }
+    with optional per metric tolerances overriding the default one.
+*/
+class metric {
+public:
+    std::string name;
+    double value;
+    bool higher_is_better = true;
+};
+
+
+class perf_baseline {
+public:
+    uint ranks = 0;
+    double tolerance = 0.25;
+    std::map<std::string, double> metrics;
+    std::map<std::string, double> tolerances;
+
+    // Throws std::invalid_argument if the file can not be read
+    void read(const std::string filename);
+    void write(const std::string filename) const;
+};
+
+
+class perf_tester {
+
+    std::vector<metric> (*to_measure)(mpi_wrapper&);
+    std::string name;
+    mpi_wrapper *pool;
+    perf_baseline *baseline;
+    bool update;
+
+public:
+    uint failures = 0;
+
+    // With update, measured values averaged over the ranks replace the baseline ones
+    perf_tester(
+        std::string name_in,
+        std::vector<metric> (*to_measure_in)(mpi_wrapper&),
+        mpi_wrapper& pool_in,
+        perf_baseline& baseline_in,
+        const bool update_in = false
+    );
+
+    void operator()();
+
+};
+
+
+
 }
 
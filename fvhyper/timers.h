@@ -0,0 +1,155 @@
+/*
+
+       ___     __                    
+      / _/  __/ /  __ _____  ___ ____
+     / _/ |/ / _ \/ // / _ \/ -_) __/
+    /_/ |___/_//_/\_, / .__/\__/_/   
+                 /___/_/             
+
+    Finite Volumes for High Performance
+
+    - Description : Phase timers header
+    - Author : Alexis Angers
+    - Contact : alexis.angers@polymtl.ca
+
+*/
+#pragma once
+
+#include <fvhyper/parallel.h>
+#include <fvhyper/counters.h>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace fvhyper {
+
+
+/*
+    Per-phase timers and counters of the solver
+    A scoped_timer adds its lifetime to the totals of its phase, timers
+    nest and their times are inclusive. Totals are per rank and only
+    touched by the solver thread. report() reduces the min/avg/max over
+    the ranks into a table and an optional json file.
+
+    Once start_trace() is called, every timer is also recorded as an
+    event in a fixed size ring buffer, the oldest events are overwritten
+    when it is full. Message timers carry the neighbor rank and bytes.
+    write_trace() merges the buffers of all ranks in a Chrome trace json
+    file, for chrome://tracing or Perfetto.
+
+    While the hardware counters of counters.h are enabled, every timer
+    also adds the counts of its lifetime to its phase.
+*/
+namespace timers {
+
+    enum phase {
+        step,
+        calc_dt,
+        calc_gradients,
+        calc_limiters,
+        calc_time_derivatives,
+        update_bounds,
+        update_comms,
+        smooth_residuals,
+        implicit_smoothing,
+        calc_residuals,
+        output,
+        monitors,
+        checkpoint,
+        mpi_send,       // posting a message to a neighbor
+        mpi_recv,       // waiting for a message from a neighbor
+        mpi_barrier,
+        n_phases
+    };
+
+    extern const char* phase_names[n_phases];
+
+    struct phase_totals {
+        double seconds = 0.;
+        uint64_t calls = 0;
+        uint64_t bytes = 0;     // data sent by the phase, if any
+        uint64_t events[counters::n_events] = {};
+    };
+
+    extern phase_totals totals[n_phases];
+
+    struct trace_event {
+        std::chrono::steady_clock::time_point begin;
+        std::chrono::steady_clock::time_point end;
+        int32_t p;
+        int32_t peer;           // neighbor rank of messages, -1 otherwise
+        uint64_t bytes;
+    };
+
+    struct event_tracer {
+        std::vector<trace_event> events;    // ring buffer, empty when not tracing
+        uint64_t recorded = 0;
+        std::chrono::steady_clock::time_point origin;
+    };
+
+    extern event_tracer tracer;
+
+    inline void record(
+        const phase p,
+        const std::chrono::steady_clock::time_point begin,
+        const std::chrono::steady_clock::time_point end,
+        const int peer,
+        const uint64_t bytes
+    ) {
+        if (tracer.events.empty()) return;
+        tracer.events[tracer.recorded % tracer.events.size()] = {begin, end, p, peer, bytes};
+        tracer.recorded += 1;
+    }
+
+    class scoped_timer {
+    public:
+        const phase p;
+        const int peer;
+        const uint64_t bytes;
+        const std::chrono::steady_clock::time_point begin;
+        uint64_t events[counters::n_events];
+
+        scoped_timer(const phase p_, const int peer_ = -1, const uint64_t bytes_ = 0) :
+            p(p_), peer(peer_), bytes(bytes_), begin(std::chrono::steady_clock::now()) {
+            if (counters::enabled()) counters::read(events);
+        }
+
+        ~scoped_timer() {
+            if (counters::enabled()) {
+                uint64_t now[counters::n_events];
+                counters::read(now);
+                for (uint e=0; e<counters::n_events; ++e) totals[p].events[e] += now[e] - events[e];
+            }
+            const auto end = std::chrono::steady_clock::now();
+            totals[p].seconds += std::chrono::duration<double>(end - begin).count();
+            totals[p].calls += 1;
+            totals[p].bytes += bytes;
+            record(p, begin, end, peer, bytes);
+        }
+    };
+
+    inline void add_bytes(const phase p, const uint64_t bytes) {
+        totals[p].bytes += bytes;
+    }
+
+    void reset();
+
+    // Collective, rank 0 prints the table and writes the json file if named
+    void report(mpi_wrapper& pool, const bool print, const std::string json_file = "");
+
+    // Collective, rank 0 prints the hardware counts of the phases, per cycle
+    // and per edge of the mesh, and writes the json file if named
+    void report_counters(mpi_wrapper& pool, const uint64_t edges, const bool print, const std::string json_file = "");
+
+    // Collective, allocate the ring buffer of events and align the clocks
+    void start_trace(const uint capacity);
+
+    // Collective, rank 0 writes the events of all ranks and stops tracing
+    void write_trace(const std::string filename, mpi_wrapper& pool);
+}
+
+
+
+}
@@ -18,10 +18,12 @@
 #include <fvhyper/explicit.h>
 #include <fvhyper/parallel.h>
 #include <fvhyper/post.h>
+#include <fvhyper/timers.h>
 
 #include <sstream>
 #include <iomanip>
 #include <fstream>
+#include <chrono>
 
 
 std::string convert_double(const double& x, uint decimals) {
@@ -147,7 +149,11 @@ namespace fvhyper {
         }
         std::map<std::string, void (*)(double*, double*, double*)> 
         bounds = {
-            {"wall", zero_flux}
+            {"wall", zero_flux},
+            {"bottom", zero_flux},
+            {"right", zero_flux},
+            {"top", zero_flux},
+            {"left", zero_flux}
         };
     }
 
@@ -254,6 +260,80 @@ fvhyper::status test_solve(fvhyper::mpi_wrapper& pool) {
 
 
 
+
+fvhyper::status test_jacobian_vector(fvhyper::mpi_wrapper& pool) {
+    fvhyper::status status;
+
+    fvhyper::generatorOptions gen;
+    gen.nx = 32;
+    gen.ny = 32;
+    fvhyper::mesh m;
+    m.generate(gen, pool);
+
+    fvhyper::residual_operator residual(m, pool);
+    const uint size = fvhyper::vars*m.cellsAreas.size();
+    std::vector<double> q(size, 0.), v(size, 0.);
+    for (uint i=0; i<m.nRealCells; ++i) {
+        q[2*i] = 0.5 + 0.2*sin(6.*m.cellsCentersX[i]);
+        q[2*i+1] = 0.3*cos(6.*m.cellsCentersY[i]);
+        // Cells of the other ranks get v through the exchange
+        if (m.cellsIsGhost[i]) continue;
+        v[2*i] = 1.;
+        v[2*i+1] = 0.5;
+    }
+    auto set_ghosts = [&](std::vector<double>& x) {
+        fvhyper::update_bounds(x, residual.gx, residual.gy, residual.limiters, m);
+        if (pool.size > 1) fvhyper::update_comms(x, m);
+    };
+    set_ghosts(q);
+    const std::vector<double> r = residual(q);
+
+    // Jacobian vector product with the cached reconstruction of q
+    std::vector<double> jv(size);
+    residual.jacobian_vector(jv, r, q, v, 1e-7);
+
+    // Central difference of the full residual
+    const double h = 1e-4;
+    std::vector<double> qp(size), qm(size);
+    for (uint i=0; i<size; ++i) {
+        qp[i] = q[i] + h*v[i];
+        qm[i] = q[i] - h*v[i];
+    }
+    set_ghosts(qp);
+    set_ghosts(qm);
+    const std::vector<double> rp = residual(qp);
+    const std::vector<double> rm = residual(qm);
+
+    // A uniform v leaves the gradients and limiters unchanged away from
+    //  the walls, whose ghost cells do not depend on q
+    const double margin = 4./gen.nx;
+    double err = 0.;
+    double scale = 0.;
+    for (uint i=0; i<m.nRealCells; ++i) {
+        if (m.cellsIsGhost[i]) continue;
+        const double x = m.cellsCentersX[i];
+        const double y = m.cellsCentersY[i];
+        if ((x < margin) || (x > 1. - margin) || (y < margin) || (y > 1. - margin)) continue;
+        for (uint k=0; k<fvhyper::vars; ++k) {
+            const uint ik = fvhyper::vars*i + k;
+            const double fd = (rp[ik] - rm[ik])/(2.*h);
+            err = std::max(err, std::abs(jv[ik] - fd));
+            scale = std::max(scale, std::abs(fd));
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &scale, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    if ((scale == 0.) || (err > 1e-5*scale)) {
+        status.success = 0;
+        return status;
+    }
+
+    status.success = fvhyper::STATUS_SUCCESS;
+    return status;
+}
+
+
+
 void gen_mesh_sol(fvhyper::mpi_wrapper& pool) {
     // Create mesh object m
     fvhyper::mesh m;
@@ -306,9 +386,164 @@ void gen_solver_sol(fvhyper::mpi_wrapper& pool) {
 
 
 
-int main() {
+
+template<class F>
+double items_per_second(F kernel, const double items) {
+    // Items processed by one call over its time, repeated for at least 0.2 s
+    kernel();
+    MPI_Barrier(MPI_COMM_WORLD);
+    uint reps = 0;
+    double elapsed = 0.;
+    auto start = std::chrono::steady_clock::now();
+    int done = 0;
+    while (!done) {
+        kernel();
+        reps += 1;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        done = (reps >= 3) && (elapsed >= 0.2);
+        MPI_Bcast(&done, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    }
+    return items*reps/elapsed;
+}
+
+
+std::vector<fvhyper::metric> perf_kernels(fvhyper::mpi_wrapper& pool) {
+    // Throughput of the explicit kernels on a generated mesh
+    fvhyper::generatorOptions gen;
+    gen.nx = 128;
+    gen.ny = 128;
+    fvhyper::mesh m;
+    m.generate(gen, pool);
+
+    const uint size = fvhyper::vars*m.cellsAreas.size();
+    std::vector<double> q(size), qt(size), gx(size), gy(size), limiters(size);
+    std::vector<double> qmin(size), qmax(size), smoother_qt(size), smoother(size);
+    for (uint i=0; i<m.cellsAreas.size(); ++i) {
+        q[2*i] = sin(6.*m.cellsCentersX[i]);
+        q[2*i+1] = cos(6.*m.cellsCentersY[i]);
+    }
+    fvhyper::solverOptions opt;
+
+    // Owned cells per second, boundary edges per second for update_bounds
+    //  as in benchmarks/kernels
+    double cells = 0.;
+    for (uint i=0; i<m.nRealCells; ++i) cells += m.cellsIsGhost[i] ? 0. : 1.;
+    const double bounds = m.boundaryEdges.size();
+
+    std::vector<fvhyper::metric> metrics(5);
+    metrics[0] = {"calc_gradients", items_per_second(
+        [&]() { fvhyper::calc_gradients(gx, gy, q, m); }, cells)};
+    metrics[1] = {"calc_limiters", items_per_second(
+        [&]() { fvhyper::calc_limiters(limiters, qmin, qmax, q, gx, gy, m); }, cells)};
+    metrics[2] = {"update_bounds", items_per_second(
+        [&]() { fvhyper::update_bounds(q, gx, gy, limiters, m); }, bounds)};
+    metrics[3] = {"calc_time_derivatives", items_per_second(
+        [&]() { fvhyper::calc_time_derivatives(qt, q, gx, gy, limiters, m); }, cells)};
+    metrics[4] = {"smooth_residuals", items_per_second(
+        [&]() { fvhyper::smooth_residuals(qt, smoother_qt, smoother, m, pool, opt); }, cells)};
+    return metrics;
+}
+
+
+std::vector<fvhyper::metric> perf_solve(fvhyper::mpi_wrapper& pool) {
+    // Steps to convergence and step throughput of a short solve
+    fvhyper::generatorOptions gen;
+    gen.nx = 32;
+    gen.ny = 32;
+    fvhyper::mesh m;
+    m.generate(gen, pool);
+
+    fvhyper::solverOptions options;
+    options.max_step = 20000;
+    options.tolerance = 1e-8;
+    options.print_interval = 100000;
+    options.verbose = false;
+
+    std::vector<double> q;
+    fvhyper::run("perf", q, pool, m, options);
+
+    namespace timers = fvhyper::timers;
+    const double steps = timers::totals[timers::step].calls;
+    double cells = 0.;
+    for (uint i=0; i<m.nRealCells; ++i) cells += m.cellsIsGhost[i] ? 0. : 1.;
+
+    std::vector<fvhyper::metric> metrics(2);
+    metrics[0] = {"steps", steps, false};
+    metrics[1] = {"cell_steps_per_second", cells*steps/timers::totals[timers::step].seconds};
+    return metrics;
+}
+
+
+int perf_main(fvhyper::mpi_wrapper& pool, int argc, char** argv) {
+    /*
+        Performance regression mode:
+            mpirun -n p ./tests perf [--baseline file] [--tolerance t] [--update]
+        Fails when a metric is worse than its baseline by more than the
+        tolerance. Baselines depend on the machine and the number of ranks,
+        regenerate them with --update.
+    */
+    std::string baseline_file = "perf_baseline.json";
+    bool update = false;
+    double tolerance = -1.;
+    for (int a=2; a<argc; ++a) {
+        const std::string arg = argv[a];
+        if ((arg == "--baseline") && (a + 1 < argc)) {
+            baseline_file = argv[++a];
+        } else if ((arg == "--tolerance") && (a + 1 < argc)) {
+            tolerance = atof(argv[++a]);
+        } else if (arg == "--update") {
+            update = true;
+        } else {
+            if (pool.rank == 0) {
+                std::cout << "\033[1;31mError\033[0m - Unknown argument " << arg << std::endl;
+            }
+            return 1;
+        }
+    }
+
+    fvhyper::perf_baseline baseline;
+    try {
+        baseline.read(baseline_file);
+    } catch (const std::invalid_argument& e) {
+        if (!update) {
+            if (pool.rank == 0) {
+                std::cout << "\033[1;31mError\033[0m - " << e.what() << std::endl;
+            }
+            return 1;
+        }
+        baseline.tolerances["solve.steps"] = 0.;
+    }
+    if (tolerance >= 0.) baseline.tolerance = tolerance;
+    if (!update && (baseline.ranks != pool.size)) {
+        if (pool.rank == 0) {
+            std::cout << "\033[1;31mError\033[0m - The baseline is for " << baseline.ranks << " mpi ranks" << std::endl;
+        }
+        return 1;
+    }
+
+    fvhyper::perf_tester perf_kernels_tester("kernels", perf_kernels, pool, baseline, update);
+    fvhyper::perf_tester perf_solve_tester  ("solve",   perf_solve,   pool, baseline, update);
+
+    perf_kernels_tester();
+    perf_solve_tester();
+
+    if (update) {
+        baseline.ranks = pool.size;
+        if (pool.rank == 0) baseline.write(baseline_file);
+    }
+    return (perf_kernels_tester.failures + perf_solve_tester.failures > 0) ? 1 : 0;
+}
+
+
+int main(int argc, char** argv) {
     fvhyper::mpi_wrapper pool;
 
+    if ((argc > 1) && (std::string(argv[1]) == "perf")) {
+        const int result = perf_main(pool, argc, argv);
+        pool.exit();
+        return result;
+    }
+
     if (pool.size != 4) {
         if (pool.rank == 0) {
             std::cout << "\033[1;31mError\033[0m - The number of mpi ranks should be 4" << std::endl;
@@ -318,9 +553,11 @@ int main() {
 
     fvhyper::tester tester_mesh ("mesh ", test_mesh,     pool);
     fvhyper::tester tester_solve("solve", test_solve,     pool);
+    fvhyper::tester tester_jv   ("jv   ", test_jacobian_vector, pool);
 
     tester_mesh();
     tester_solve();
+    tester_jv();
 
     //gen_mesh_sol(pool);
     //gen_solver_sol(pool);